@@ -1,22 +1,177 @@
+#include <fstream>
 #include <iostream>
 #include <string>
+#include <boost/filesystem.hpp>
+#include <jx/ClassArchive.h>
 #include <jx/ClassFile.h>
+#include <jx/ClassPrefetcher.h>
 #include <jx/Interpreter.h>
+#include <jx/Profiler.h>
+#include <jx/StackSampler.h>
 #include <jx/Util.h>
 
+/** Parses sizes like 512k, 64m or 1g. */
+static size_t parseSize(const std::string& value) {
+    size_t pos = 0;
+    size_t size = std::stoul(value, &pos);
+    std::string unit = value.substr(pos);
+    if (unit == "k" || unit == "K"){
+        return size * 1024;
+    } else if (unit == "m" || unit == "M"){
+        return size * 1024 * 1024;
+    } else if (unit == "g" || unit == "G"){
+        return size * 1024 * 1024 * 1024;
+    } else if (unit.empty()){
+        return size;
+    }
+    throw std::invalid_argument("Invalid size " + value);
+}
+
+/** Profiling requested on the command line. */
+struct ProfileOptions {
+    bool report = false;
+    std::string jsonFile;
+    int sampleIntervalMicros = Profiler::DefaultSampleIntervalMicros;
+
+    std::string foldedStacksFile;
+    int stackSampleIntervalMicros = StackSampler::DefaultIntervalMicros;
+
+    bool profiling() const { return report || !jsonFile.empty(); }
+    bool sampling() const { return !foldedStacksFile.empty(); }
+};
+
+/** Summary of the garbage collections, for -verbose:gc. */
+static void writeGcStatistics(const GcStatistics& stats) {
+    std::cerr << "GC: " << stats.collections << " collections, "
+              << stats.totalPauseMicros << "us total pause, "
+              << stats.totalBytesFreed << " bytes freed, "
+              << stats.liveObjects << " live objects (" << stats.liveBytes << " bytes, heap " << stats.heapBytes << " bytes) after the last one" << std::endl;
+}
+
+static void checkWritten(const std::ostream& out, const std::string& file) {
+    if (!out){
+        std::cerr << "Could not write profile to " << file << std::endl;
+    }
+}
+
+/** Writes the requested reports, the human readable one to stderr. */
+static void writeProfiles(const ProfileOptions& options, Profiler& profiler, StackSampler& sampler) {
+    profiler.stopSampling();
+    sampler.stop();
+    if (options.report){
+        profiler.writeReport(std::cerr);
+    }
+    if (!options.jsonFile.empty()){
+        std::ofstream out (options.jsonFile.c_str());
+        profiler.writeJson(out);
+        checkWritten(out, options.jsonFile);
+    }
+    if (options.sampling()){
+        std::ofstream out (options.foldedStacksFile.c_str());
+        sampler.writeFolded(out);
+        checkWritten(out, options.foldedStacksFile);
+    }
+}
+
+/** Class data sharing, see ClassArchive. */
+enum ShareMode { ShareAuto, ShareOff, ShareDump };
+
+/** Uses the archive if it exists and fits the class path. */
+static void useArchive(ClassLoader& classLoader, const std::string& archiveFile) {
+    if (!boost::filesystem::exists(archiveFile)){
+        return;
+    }
+    try {
+        classLoader.useArchive(std::make_shared<ClassArchive>(archiveFile));
+    } catch (std::invalid_argument& e){
+        std::cerr << "Ignoring class archive: " << e.what() << std::endl;
+    }
+}
+
 int main(int argc, char* argv[]) {
-    if (argc != 2){
-        std::cout << "Usage " << argv[0] << " <class-file>" << std::endl;
+    util::onStart(argc, argv);
+    size_t maxHeapSize = VmMemory::DefaultMaxHeapSize;
+    ShareMode shareMode = ShareAuto;
+    std::string archiveFile = util::executableDirectory() + "/../lib/classes.jsa";
+    size_t prefetchThreads = ClassPrefetcher::defaultWorkers();
+    ProfileOptions profileOptions;
+    bool verboseGc = false;
+    int argIndex = 1;
+    for (; argIndex < argc - 1; argIndex++){
+        std::string option = argv[argIndex];
+        if (option.compare(0, 4, "-Xmx") == 0){
+            maxHeapSize = parseSize(option.substr(4));
+        } else if (option == "-Xshare:auto"){
+            shareMode = ShareAuto;
+        } else if (option == "-Xshare:off"){
+            shareMode = ShareOff;
+        } else if (option == "-Xshare:dump"){
+            shareMode = ShareDump;
+        } else if (option.compare(0, 22, "-XX:SharedArchiveFile=") == 0){
+            archiveFile = option.substr(22);
+        } else if (option.compare(0, 25, "-XX:ClassPrefetchThreads=") == 0){
+            int threads = std::stoi(option.substr(25));
+            if (threads < 0){
+                throw std::invalid_argument("Invalid " + option);
+            }
+            prefetchThreads = threads;
+        } else if (option == "-verbose:gc"){
+            verboseGc = true;
+        } else if (option == "--profile"){
+            profileOptions.report = true;
+        } else if (option.compare(0, 15, "--profile-json=") == 0){
+            profileOptions.jsonFile = option.substr(15);
+        } else if (option.compare(0, 19, "--profile-interval=") == 0){
+            profileOptions.sampleIntervalMicros = std::stoi(option.substr(19));
+        } else if (option.compare(0, 16, "--sample-stacks=") == 0){
+            profileOptions.foldedStacksFile = option.substr(16);
+        } else if (option.compare(0, 18, "--sample-interval=") == 0){
+            profileOptions.stackSampleIntervalMicros = std::stoi(option.substr(18));
+        } else {
+            break;
+        }
+    }
+    if (argIndex != argc - 1){
+        std::cout << "Usage " << argv[0] << " [-Xmx<size>] [-Xshare:auto|off|dump] [-XX:SharedArchiveFile=<file>] [-XX:ClassPrefetchThreads=<n>] [-verbose:gc] [--profile] [--profile-json=<file>] [--profile-interval=<micros>] [--sample-stacks=<file>] [--sample-interval=<micros>] <class-file>" << std::endl;
         return 1;
     }
-    util::onStart(argc, argv);
 
-    std::string classFileName = argv[1];
+    std::string classFileName = argv[argIndex];
 
 
     Interpreter interpreter;
+    interpreter.memory().setMaxHeapSize(maxHeapSize);
     interpreter.classLoader().addDefaultPaths();
-    interpreter.executeFile(classFileName);
+    if (shareMode == ShareAuto){
+        useArchive(interpreter.classLoader(), archiveFile);
+    } else if (shareMode == ShareDump){
+        interpreter.classLoader().recordClasses();
+    }
+    interpreter.classLoader().enablePrefetching(prefetchThreads);
 
+    Profiler profiler;
+    if (profileOptions.profiling()){
+        interpreter.setProfiler(&profiler);
+        profiler.startSampling(profileOptions.sampleIntervalMicros);
+    }
+    StackSampler sampler;
+    if (profileOptions.sampling()){
+        interpreter.setStackSampler(&sampler);
+        sampler.start(profileOptions.stackSampleIntervalMicros);
+    }
+    try {
+        interpreter.executeFile(classFileName);
+    } catch (...) {
+        writeProfiles(profileOptions, profiler, sampler);
+        throw;
+    }
+    writeProfiles(profileOptions, profiler, sampler);
+    if (verboseGc){
+        writeGcStatistics(interpreter.memory().gcStatistics());
+    }
+
+    if (shareMode == ShareDump){
+        interpreter.classLoader().writeArchive(archiveFile);
+    }
     return 0;
 }
\ No newline at end of file
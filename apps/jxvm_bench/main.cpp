@@ -0,0 +1,497 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <functional>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <jx/ClassFile.h>
+#include <jx/Interpreter.h>
+#include <jx/VmMemory.h>
+#include <jx/Util.h>
+
+// Benchmarks of the VM: internals (no Java runtime needed), Java micro benchmarks
+// and macro benchmarks (startup, algorithm kernels) from bench.jar.
+// Each benchmark is calibrated to run long enough, then measured in rounds over the whole suite.
+// Every round contributes the median of its repetitions; the mean of the rounds is reported
+// together with its confidence interval, which --compare uses as noise bound.
+
+namespace {
+
+struct Options {
+    std::string filter;
+    /** Repetitions per round. */
+    int repetitions = 5;
+    /** Passes over all benchmarks, so that the variance between runs shows up. */
+    int rounds = 5;
+    /** Minimum duration of a single repetition. */
+    double minMillis = 50;
+    std::string jsonFile;
+    std::string compareFile;
+    /** Slowdown in percent reported as regression (if above the noise). */
+    double threshold = 5;
+    std::string helloWorld;
+};
+
+struct Result {
+    std::string name;
+    uint64_t ops = 0;
+    /** Mean of the round medians. */
+    double nsPerOp = 0;
+    double minNsPerOp = 0;
+    /** Median absolute deviation of all repetitions relative to their median, in percent. */
+    double spreadPercent = 0;
+    /** Half width of the 95% confidence interval of nsPerOp relative to it, in percent. */
+    double confidencePercent = 0;
+    std::vector<double> roundNsPerOp;
+    /** Executed bytecodes per operation, negative if not applicable. */
+    double instructionsPerOp = -1;
+};
+
+struct Benchmark {
+    std::string name;
+    /** Runs the given number of operations. */
+    std::function<void (uint64_t)> run;
+    /** Returns the bytecodes executed by the given number of operations, optional. */
+    std::function<uint64_t (uint64_t)> countInstructions;
+    /** Called before each timed run, optional. */
+    std::function<void ()> setUp;
+};
+
+double seconds(const Benchmark& benchmark, uint64_t ops) {
+    if (benchmark.setUp){
+        benchmark.setUp();
+    }
+    auto start = std::chrono::steady_clock::now();
+    benchmark.run(ops);
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t middle = values.size() / 2;
+    return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+}
+
+/** Two sided 95% quantile of Student's t distribution, conservative above 10 degrees of freedom. */
+double studentT95(size_t degreesOfFreedom) {
+    static const double table[] = { 12.71, 4.30, 3.18, 2.78, 2.57, 2.45, 2.36, 2.31, 2.26, 2.23 };
+    return degreesOfFreedom <= 10 ? table[degreesOfFreedom - 1] : 2.2;
+}
+
+/** Number of operations for a run of at least minMillis, doubles as warm up. */
+uint64_t calibrate(const Benchmark& benchmark, const Options& options) {
+    uint64_t ops = 1;
+    double minSeconds = options.minMillis / 1000;
+    while (true){
+        double elapsed = seconds(benchmark, ops);
+        if (elapsed >= minSeconds || ops >= INT_MAX / 2){
+            return ops;
+        }
+        double factor = elapsed > 0 ? minSeconds / elapsed * 1.2 : 10;
+        ops = std::min<uint64_t>(INT_MAX / 2, ops * std::max(2.0, std::min(10.0, factor)));
+    }
+}
+
+/** Adds one round of repetitions to result. */
+void measureRound(const Benchmark& benchmark, const Options& options, Result& result, std::vector<double>& samples) {
+    std::vector<double> nsPerOp;
+    for (int i = 0; i < options.repetitions; i++){
+        nsPerOp.push_back(seconds(benchmark, result.ops) * 1e9 / result.ops);
+    }
+    result.roundNsPerOp.push_back(median(nsPerOp));
+    samples.insert(samples.end(), nsPerOp.begin(), nsPerOp.end());
+}
+
+void summarize(const Benchmark& benchmark, const std::vector<double>& samples, Result& result) {
+    const std::vector<double>& rounds = result.roundNsPerOp;
+    double sum = 0;
+    for (double value : rounds){
+        sum += value;
+    }
+    result.nsPerOp = sum / rounds.size();
+    result.minNsPerOp = *std::min_element(samples.begin(), samples.end());
+
+    double middle = median(samples);
+    std::vector<double> deviations;
+    for (double value : samples){
+        deviations.push_back(std::fabs(value - middle));
+    }
+    result.spreadPercent = middle > 0 ? median(deviations) / middle * 100 : 0;
+
+    if (rounds.size() > 1 && result.nsPerOp > 0){
+        double squares = 0;
+        for (double value : rounds){
+            squares += (value - result.nsPerOp) * (value - result.nsPerOp);
+        }
+        double standardError = std::sqrt(squares / (rounds.size() - 1) / rounds.size());
+        result.confidencePercent = studentT95(rounds.size() - 1) * standardError / result.nsPerOp * 100;
+    } else {
+        // A single round says nothing about the variance between runs
+        result.confidencePercent = result.spreadPercent;
+    }
+    if (benchmark.countInstructions){
+        result.instructionsPerOp = (double) benchmark.countInstructions(result.ops) / result.ops;
+    }
+}
+
+/** Class with two int and two reference fields. */
+ClassFilePtr createBenchClass() {
+    ByteArray bytes = { 0xca, 0xfe, 0xba, 0xbe, 0, 0, 0, 52 };
+    auto putU2 = [&bytes](uint16_t value) {
+        bytes.push_back(value >> 8);
+        bytes.push_back(value & 0xff);
+    };
+    auto putUtf8 = [&](const std::string& value) {
+        bytes.push_back(ConstantEntry::Utf8Tag);
+        putU2((uint16_t) value.size());
+        bytes.insert(bytes.end(), value.begin(), value.end());
+    };
+    putU2(11);
+    putUtf8("jx/Bench");                        // 1
+    bytes.push_back(ConstantEntry::ClassTag);   // 2
+    putU2(1);
+    putUtf8("java/lang/Object");                // 3
+    bytes.push_back(ConstantEntry::ClassTag);   // 4
+    putU2(3);
+    putUtf8("I");                               // 5
+    putUtf8("Ljava/lang/Object;");              // 6
+    const char* names[] = { "a", "b", "c", "d" };
+    for (const char* name : names){             // 7 - 10
+        putUtf8(name);
+    }
+    putU2(0x21);
+    putU2(2);
+    putU2(4);
+    putU2(0); // interfaces
+    putU2(4);
+    for (uint16_t i = 0; i < 4; i++){
+        putU2(0x1);
+        putU2(7 + i);
+        putU2(i < 2 ? 5 : 6);
+        putU2(0);
+    }
+    putU2(0); // methods
+    putU2(0); // attributes
+
+    BinaryReader reader(bytes);
+    ClassFilePtr result = std::make_shared<ClassFile>(ClassFile::parse(reader));
+    result->layoutFields();
+    return result;
+}
+
+/** Allocation of VmMemory, collecting garbage (nothing is reachable) when the heap asks for it.
+    Each run starts on a fresh VmMemory, so heap and collection state don't carry over. */
+void addMemoryBenchmarks(std::vector<Benchmark>& benchmarks, const ClassFilePtr& benchClass) {
+    auto allocation = [](const std::string& name, const std::function<void (VmMemory&)>& allocate) {
+        auto memory = std::make_shared<std::unique_ptr<VmMemory>>();
+        Benchmark benchmark;
+        benchmark.name = name;
+        benchmark.setUp = [memory]() {
+            memory->reset();
+            memory->reset(new VmMemory());
+        };
+        benchmark.run = [memory, allocate](uint64_t ops) {
+            VmMemory& heap = **memory;
+            for (uint64_t i = 0; i < ops; i++){
+                allocate(heap);
+                if (heap.needsCollection()){
+                    heap.collect([](VmMemory&) {});
+                }
+            }
+        };
+        return benchmark;
+    };
+    benchmarks.push_back(allocation("vm/alloc object (4 fields)", [benchClass](VmMemory& memory) {
+        memory.allocateObject(benchClass);
+    }));
+    benchmarks.push_back(allocation("vm/alloc char[16]", [](VmMemory& memory) {
+        memory.allocateArray(Char, 16);
+    }));
+    benchmarks.push_back(allocation("vm/alloc Object[8]", [](VmMemory& memory) {
+        memory.allocateObjectArray(8, "Ljava/lang/Object;");
+    }));
+}
+
+/** System.arraycopy between two char arrays of copyMemory, which is never collected. */
+void addArrayCopyBenchmarks(std::vector<Benchmark>& benchmarks, VmMemory& copyMemory) {
+    const int32_t copyLengths[] = { 16, 4096, 4 * 1024 * 1024 };
+    for (int32_t length : copyLengths){
+        Array* src = copyMemory.allocateArray(Char, length).array();
+        Array* target = copyMemory.allocateArray(Char, length).array();
+        Benchmark benchmark;
+        benchmark.name = "vm/arraycopy char[" + util::toString(length) + "]";
+        benchmark.run = [src, target, length](uint64_t ops) {
+            for (uint64_t i = 0; i < ops; i++){
+                Array::copy(*src, 0, *target, 0, length);
+            }
+        };
+        benchmarks.push_back(benchmark);
+    }
+}
+
+/** Redirects the output of Java programs (written to file descriptor 1) to /dev/null while alive. */
+class SilencedStdout {
+public:
+    SilencedStdout() {
+        std::cout.flush();
+        mSaved = dup(1);
+        int devNull = open("/dev/null", O_WRONLY);
+        dup2(devNull, 1);
+        close(devNull);
+    }
+    ~SilencedStdout() {
+        dup2(mSaved, 1);
+        close(mSaved);
+    }
+private:
+    int mSaved;
+};
+
+/** Instructions are only counted by the switch engine. */
+uint64_t countInstructions(Interpreter& interpreter, const std::function<void ()>& run) {
+    DispatchMode mode = interpreter.dispatchMode();
+    interpreter.setDispatchMode(SwitchDispatch);
+    uint64_t before = interpreter.instructionCount();
+    run();
+    uint64_t result = interpreter.instructionCount() - before;
+    interpreter.setDispatchMode(mode);
+    return result;
+}
+
+/** Static int method(int n) of bench.jar, n being the number of operations. */
+Benchmark javaBenchmark(Interpreter& interpreter, const std::string& name, const std::string& className, const std::string& methodName) {
+    auto call = [&interpreter, className, methodName](uint64_t ops) {
+        Variables arguments;
+        arguments.push(Variable((int32_t) std::min<uint64_t>(ops, INT_MAX)));
+        interpreter.callStatic(className, methodName, arguments);
+    };
+    Benchmark benchmark;
+    benchmark.name = name;
+    benchmark.run = call;
+    benchmark.countInstructions = [&interpreter, call](uint64_t ops) {
+        return countInstructions(interpreter, [&]() { call(ops); });
+    };
+    return benchmark;
+}
+
+void addJavaBenchmarks(std::vector<Benchmark>& benchmarks, Interpreter& interpreter) {
+    const char* micro[] = { "arithmetic", "fieldAccess", "virtualCall", "interfaceCall", "allocation",
+                            "stringConcat", "arrayCopy", "lookupSwitch", "tableSwitch" };
+    for (const char* method : micro){
+        benchmarks.push_back(javaBenchmark(interpreter, std::string("micro/") + method, "jx/bench/Benchmarks", method));
+    }
+    const char* kernels[] = { "sieve", "sort", "matrix", "fannkuch" };
+    for (const char* method : kernels){
+        benchmarks.push_back(javaBenchmark(interpreter, std::string("kernel/") + method, "jx/bench/Kernels", method));
+    }
+}
+
+/** Fresh interpreter running the main method of a class file, including class loading and core initialization. */
+Benchmark startupBenchmark(const std::string& classFile) {
+    auto start = [classFile](Interpreter& interpreter) {
+        SilencedStdout silenced;
+        interpreter.classLoader().addDefaultPaths();
+        interpreter.executeFile(classFile);
+    };
+    Benchmark benchmark;
+    benchmark.name = "startup/" + boost::filesystem::path(classFile).stem().string();
+    benchmark.run = [start](uint64_t ops) {
+        for (uint64_t i = 0; i < ops; i++){
+            Interpreter interpreter;
+            start(interpreter);
+        }
+    };
+    benchmark.countInstructions = [start](uint64_t ops) {
+        uint64_t result = 0;
+        for (uint64_t i = 0; i < ops; i++){
+            Interpreter interpreter;
+            result += countInstructions(interpreter, [&]() { start(interpreter); });
+        }
+        return result;
+    };
+    return benchmark;
+}
+
+void printResult(const Result& result) {
+    std::cout << std::left << std::setw(32) << result.name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(14) << result.nsPerOp << std::setw(14) << result.minNsPerOp
+              << std::setw(9) << result.spreadPercent << "%" << std::setw(9) << result.confidencePercent << "%";
+    if (result.instructionsPerOp >= 0){
+        std::cout << std::setw(14) << result.instructionsPerOp;
+    } else {
+        std::cout << std::setw(14) << "-";
+    }
+    std::cout << std::endl;
+}
+
+void writeJson(const std::vector<Result>& results, const std::string& file) {
+    std::ofstream out (file.c_str());
+    out << std::setprecision(10) << "{\"benchmarks\":[" << std::endl;
+    for (size_t i = 0; i < results.size(); i++){
+        const Result& r = results[i];
+        out << "  {\"name\":\"" << r.name << "\",\"ops\":" << r.ops << ",\"nsPerOp\":" << r.nsPerOp
+            << ",\"minNsPerOp\":" << r.minNsPerOp << ",\"spreadPercent\":" << r.spreadPercent
+            << ",\"confidencePercent\":" << r.confidencePercent << ",\"rounds\":[";
+        for (size_t round = 0; round < r.roundNsPerOp.size(); round++){
+            out << (round ? "," : "") << r.roundNsPerOp[round];
+        }
+        out << "]";
+        if (r.instructionsPerOp >= 0){
+            out << ",\"instructionsPerOp\":" << r.instructionsPerOp;
+        }
+        out << "}" << (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+    out << "]}" << std::endl;
+    if (!out){
+        throw std::runtime_error("Could not write " + file);
+    }
+}
+
+/** Prints the change against a baseline written with --json, returns the number of regressions. */
+int compare(const std::vector<Result>& results, const Options& options) {
+    boost::property_tree::ptree baseline;
+    boost::property_tree::read_json(options.compareFile, baseline);
+    std::map<std::string, Result> baselineResults;
+    for (const auto& entry : baseline.get_child("benchmarks")){
+        Result result;
+        result.nsPerOp = entry.second.get<double>("nsPerOp");
+        result.spreadPercent = entry.second.get<double>("spreadPercent");
+        // Baselines without rounds only know the variance within the run
+        result.confidencePercent = entry.second.get<double>("confidencePercent", result.spreadPercent);
+        result.instructionsPerOp = entry.second.get<double>("instructionsPerOp", -1);
+        baselineResults[entry.second.get<std::string>("name")] = result;
+    }
+
+    std::cout << std::endl << "Compared to " << options.compareFile << ":" << std::endl;
+    int regressions = 0;
+    for (const Result& result : results){
+        auto found = baselineResults.find(result.name);
+        if (found == baselineResults.end()){
+            continue;
+        }
+        const Result& base = found->second;
+        double change = (result.nsPerOp - base.nsPerOp) / base.nsPerOp * 100;
+        // Only a change beyond both confidence intervals is significant
+        double noise = base.confidencePercent + result.confidencePercent;
+        std::cout << std::left << std::setw(32) << result.name << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(14) << base.nsPerOp << std::setw(14) << result.nsPerOp
+                  << std::setw(9) << std::showpos << change << std::noshowpos << "%";
+        if (base.instructionsPerOp >= 0 && result.instructionsPerOp >= 0 && base.instructionsPerOp != result.instructionsPerOp){
+            std::cout << "  instr/op " << base.instructionsPerOp << " -> " << result.instructionsPerOp;
+        }
+        if (change > options.threshold && change > noise){
+            std::cout << "  REGRESSION";
+            regressions++;
+        } else if (-change > options.threshold && -change > noise){
+            std::cout << "  improved";
+        }
+        std::cout << std::endl;
+    }
+    return regressions;
+}
+
+void usage(const char* name) {
+    std::cout << "Usage " << name << " [--filter=<text>] [--repetitions=<n>] [--rounds=<n>] [--min-time=<ms>] [--json=<file>]"
+              << " [--compare=<file>] [--threshold=<percent>] [--hello=<class-file>]" << std::endl;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    util::onStart(argc, argv);
+    Options options;
+    options.helloWorld = util::executableDirectory() + "/../../manual_test/hello_world/HelloWorld.class";
+    for (int i = 1; i < argc; i++){
+        std::string option = argv[i];
+        size_t equals = option.find('=');
+        std::string key = option.substr(0, equals);
+        std::string value = equals == std::string::npos ? std::string() : option.substr(equals + 1);
+        if (key == "--filter"){
+            options.filter = value;
+        } else if (key == "--repetitions"){
+            options.repetitions = std::max(1, std::stoi(value));
+        } else if (key == "--rounds"){
+            options.rounds = std::max(1, std::stoi(value));
+        } else if (key == "--min-time"){
+            options.minMillis = std::stod(value);
+        } else if (key == "--json"){
+            options.jsonFile = value;
+        } else if (key == "--compare"){
+            options.compareFile = value;
+        } else if (key == "--threshold"){
+            options.threshold = std::stod(value);
+        } else if (key == "--hello"){
+            options.helloWorld = value;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<Benchmark> benchmarks;
+    ClassFilePtr benchClass = createBenchClass();
+    addMemoryBenchmarks(benchmarks, benchClass);
+    VmMemory copyMemory;
+    addArrayCopyBenchmarks(benchmarks, copyMemory);
+
+    // Java benchmarks need the runtime library (JAVA_HOME) and bench.jar
+    std::unique_ptr<Interpreter> interpreter;
+    std::string benchJar = util::executableDirectory() + "/../lib/bench.jar";
+    if (!getenv("JAVA_HOME")){
+        std::cout << "JAVA_HOME not set, skipping Java benchmarks" << std::endl;
+    } else if (!boost::filesystem::exists(benchJar)){
+        std::cout << benchJar << " not found, skipping Java benchmarks" << std::endl;
+    } else {
+        interpreter.reset(new Interpreter());
+        interpreter->classLoader().addDefaultPaths();
+        interpreter->classLoader().addPath(benchJar);
+        addJavaBenchmarks(benchmarks, *interpreter);
+        if (boost::filesystem::exists(options.helloWorld)){
+            benchmarks.push_back(startupBenchmark(options.helloWorld));
+        } else {
+            std::cout << options.helloWorld << " not found, skipping startup benchmark" << std::endl;
+        }
+    }
+
+    std::cout << std::left << std::setw(32) << "benchmark" << std::right << std::setw(14) << "ns/op"
+              << std::setw(14) << "min ns/op" << std::setw(10) << "spread" << std::setw(10) << "+-95%" << std::setw(14) << "instr/op" << std::endl;
+    std::vector<const Benchmark*> selected;
+    std::vector<Result> results;
+    for (const Benchmark& benchmark : benchmarks){
+        if (benchmark.name.find(options.filter) != std::string::npos){
+            selected.push_back(&benchmark);
+            Result result;
+            result.name = benchmark.name;
+            result.ops = calibrate(benchmark, options);
+            results.push_back(result);
+        }
+    }
+    // Rounds run over all benchmarks, so that slow drifts of the machine affect every round alike
+    std::vector<std::vector<double>> samples (selected.size());
+    for (int round = 0; round < options.rounds; round++){
+        for (size_t i = 0; i < selected.size(); i++){
+            measureRound(*selected[i], options, results[i], samples[i]);
+        }
+    }
+    for (size_t i = 0; i < selected.size(); i++){
+        summarize(*selected[i], samples[i], results[i]);
+        printResult(results[i]);
+    }
+
+    if (!options.jsonFile.empty()){
+        writeJson(results, options.jsonFile);
+    }
+    if (!options.compareFile.empty() && compare(results, options) > 0){
+        return 2;
+    }
+    return 0;
+}
@@ -12,6 +12,7 @@ fi
 cd javalib
 ant jar
 ant test_jar
+ant bench_jar
 cd ..
 
 # Building CPP Code
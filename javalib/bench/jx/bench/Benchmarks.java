@@ -0,0 +1,134 @@
+package jx.bench;
+
+// Micro benchmarks run by jxvm_bench. Each one runs n operations and returns a checksum,
+// so that the work can't be skipped and results can be compared between engines.
+class Benchmarks {
+
+    public static int arithmetic(int n) {
+        int a = 1;
+        int b = 3;
+        for (int i = 0; i < n; i++) {
+            a = a * 31 + b;
+            b = (b ^ i) - (a >> 3);
+        }
+        return a + b;
+    }
+
+    static class Counter {
+        int value;
+        int step = 3;
+    }
+
+    public static int fieldAccess(int n) {
+        Counter counter = new Counter();
+        for (int i = 0; i < n; i++) {
+            counter.value += counter.step;
+        }
+        return counter.value;
+    }
+
+    static abstract class Shape {
+        abstract int area();
+    }
+
+    static class Rect extends Shape {
+        int w = 2;
+        int h = 3;
+        int area() { return w * h; }
+    }
+
+    static class Square extends Shape {
+        int side = 4;
+        int area() { return side * side; }
+    }
+
+    public static int virtualCall(int n) {
+        Shape[] shapes = { new Rect(), new Square() };
+        int sum = 0;
+        for (int i = 0; i < n; i++) {
+            sum += shapes[i & 1].area();
+        }
+        return sum;
+    }
+
+    interface Scaler {
+        int scale(int value);
+    }
+
+    static class Doubler implements Scaler {
+        public int scale(int value) { return value * 2; }
+    }
+
+    static class Tripler implements Scaler {
+        public int scale(int value) { return value * 3; }
+    }
+
+    public static int interfaceCall(int n) {
+        Scaler[] scalers = { new Doubler(), new Tripler() };
+        int sum = 0;
+        for (int i = 0; i < n; i++) {
+            sum += scalers[i & 1].scale(i);
+        }
+        return sum;
+    }
+
+    public static int allocation(int n) {
+        int sum = 0;
+        for (int i = 0; i < n; i++) {
+            Counter counter = new Counter();
+            sum += counter.step;
+        }
+        return sum;
+    }
+
+    public static int stringConcat(int n) {
+        int sum = 0;
+        for (int i = 0; i < n; i++) {
+            String s = "value " + i + ',';
+            sum += s.length();
+        }
+        return sum;
+    }
+
+    public static int arrayCopy(int n) {
+        char[] source = new char[64];
+        char[] target = new char[64];
+        for (int i = 0; i < source.length; i++) {
+            source[i] = (char) ('a' + i % 26);
+        }
+        for (int i = 0; i < n; i++) {
+            System.arraycopy(source, i & 7, target, 0, 56);
+        }
+        return target[0] + target[55];
+    }
+
+    public static int lookupSwitch(int n) {
+        int sum = 0;
+        for (int i = 0; i < n; i++) {
+            switch ((i * 7) & 15) {
+                case 1: sum += 3; break;
+                case 100: sum += 5; break;
+                case 1000: sum += 7; break;
+                case 10000: sum -= 1; break;
+                default: sum += 1;
+            }
+        }
+        return sum;
+    }
+
+    public static int tableSwitch(int n) {
+        int sum = 0;
+        for (int i = 0; i < n; i++) {
+            switch (i & 7) {
+                case 0: sum += 3; break;
+                case 1: sum += 5; break;
+                case 2: sum += 7; break;
+                case 3: sum -= 1; break;
+                case 4: sum ^= 2; break;
+                case 5: sum += 11; break;
+                default: sum += 1;
+            }
+        }
+        return sum;
+    }
+}
@@ -0,0 +1,146 @@
+package jx.bench;
+
+// Small algorithm kernels run by jxvm_bench, n is the number of repetitions.
+class Kernels {
+
+    /** Counts the primes below 10000 with the sieve of Eratosthenes. */
+    public static int sieve(int n) {
+        int count = 0;
+        for (int r = 0; r < n; r++) {
+            boolean[] composite = new boolean[10000];
+            count = 0;
+            for (int i = 2; i < composite.length; i++) {
+                if (!composite[i]) {
+                    count++;
+                    for (int j = i * i; j < composite.length; j += i) {
+                        composite[j] = true;
+                    }
+                }
+            }
+        }
+        return count;
+    }
+
+    /** Quick sorts 1000 pseudo random ints. */
+    public static int sort(int n) {
+        int checksum = 0;
+        for (int r = 0; r < n; r++) {
+            int[] values = new int[1000];
+            int seed = 42 + r;
+            for (int i = 0; i < values.length; i++) {
+                seed = seed * 1103515245 + 12345;
+                values[i] = seed >>> 8;
+            }
+            quickSort(values, 0, values.length - 1);
+            checksum += values[0] ^ values[values.length / 2];
+        }
+        return checksum;
+    }
+
+    private static void quickSort(int[] values, int low, int high) {
+        while (low < high) {
+            int pivot = values[(low + high) >>> 1];
+            int i = low;
+            int j = high;
+            while (i <= j) {
+                while (values[i] < pivot) i++;
+                while (values[j] > pivot) j--;
+                if (i <= j) {
+                    int t = values[i];
+                    values[i] = values[j];
+                    values[j] = t;
+                    i++;
+                    j--;
+                }
+            }
+            if (j - low < high - i) {
+                quickSort(values, low, j);
+                low = i;
+            } else {
+                quickSort(values, i, high);
+                high = j;
+            }
+        }
+    }
+
+    /** Multiplies two 24x24 matrices. */
+    public static int matrix(int n) {
+        final int size = 24;
+        double[] a = new double[size * size];
+        double[] b = new double[size * size];
+        double[] c = new double[size * size];
+        for (int i = 0; i < a.length; i++) {
+            a[i] = i % 7;
+            b[i] = i % 5;
+        }
+        for (int r = 0; r < n; r++) {
+            for (int i = 0; i < size; i++) {
+                for (int j = 0; j < size; j++) {
+                    double sum = 0;
+                    for (int k = 0; k < size; k++) {
+                        sum += a[i * size + k] * b[k * size + j];
+                    }
+                    c[i * size + j] = sum;
+                }
+            }
+        }
+        return (int) c[size * size - 1];
+    }
+
+    /** Maximum number of flips of the pancakes of all permutations of 7 (fannkuch). */
+    public static int fannkuch(int n) {
+        int result = 0;
+        for (int r = 0; r < n; r++) {
+            result = fannkuch7();
+        }
+        return result;
+    }
+
+    private static int fannkuch7() {
+        final int size = 7;
+        int[] perm = new int[size];
+        int[] perm1 = new int[size];
+        int[] count = new int[size];
+        for (int i = 0; i < size; i++) {
+            perm1[i] = i;
+        }
+        int maxFlips = 0;
+        int todo = size;
+        while (true) {
+            for (; todo != 1; todo--) {
+                count[todo - 1] = todo;
+            }
+            for (int i = 0; i < size; i++) {
+                perm[i] = perm1[i];
+            }
+            int flips = 0;
+            int first;
+            while ((first = perm[0]) != 0) {
+                for (int i = 0, j = first; i < j; i++, j--) {
+                    int t = perm[i];
+                    perm[i] = perm[j];
+                    perm[j] = t;
+                }
+                flips++;
+            }
+            if (flips > maxFlips) {
+                maxFlips = flips;
+            }
+            while (true) {
+                if (todo == size) {
+                    return maxFlips;
+                }
+                int perm0 = perm1[0];
+                for (int i = 0; i < todo; i++) {
+                    perm1[i] = perm1[i + 1];
+                }
+                perm1[todo] = perm0;
+                count[todo]--;
+                if (count[todo] > 0) {
+                    break;
+                }
+                todo++;
+            }
+        }
+    }
+}
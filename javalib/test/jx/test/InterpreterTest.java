@@ -185,6 +185,189 @@ class InterpreterTest {
         }
     }
 
+    static class FieldBase {
+        private int secret = 1;
+        int value = 2;
+
+        int baseSecret() { return secret; }
+    }
+
+    static class FieldDerived extends FieldBase {
+        // Shadows the private field of the base class
+        private int secret = 10;
+        int other = 20;
+
+        int derivedSecret() { return secret; }
+    }
+
+    public static int fieldLayoutTest() {
+        FieldDerived derived = new FieldDerived();
+        derived.value += 100;
+        return derived.baseSecret() + derived.derivedSecret() + derived.value + derived.other;
+    }
+
+    interface Shape {
+        int area();
+        default int scaledArea(int factor) { return area() * factor; }
+    }
+
+    interface Named {
+        int nameLength();
+    }
+
+    static class Rect implements Shape, Named {
+        int w = 2;
+        int h = 3;
+        public int area() { return w * h; }
+        public int nameLength() { return 4; }
+    }
+
+    static class Square extends Rect {
+        Square() { w = 5; h = 5; }
+        // Overrides a default method through the class hierarchy
+        public int scaledArea(int factor) { return area() + factor; }
+        public int nameLength() { return 6; }
+    }
+
+    public static int virtualDispatchTest() {
+        Shape[] shapes = { new Rect(), new Square(), new Rect() };
+        int sum = 0;
+        for (Shape s : shapes) {
+            sum += s.area() + s.scaledArea(10) + ((Named) s).nameLength();
+        }
+        Rect rect = new Square();
+        // Inherited default method called on a class typed receiver
+        Rect plain = new Rect();
+        return sum + rect.area() + plain.scaledArea(2);
+    }
+
+    interface Level {
+        default int level() { return 1; }
+    }
+
+    interface RefinedLevel extends Level {
+        default int level() { return 2; }
+    }
+
+    static class Leveled implements RefinedLevel, Level {
+    }
+
+    static class SubLeveled extends Leveled implements Level {
+    }
+
+    public static int defaultOverrideTest() {
+        Level level = new Leveled();
+        RefinedLevel refined = new Leveled();
+        Level sub = new SubLeveled();
+        return level.level() * 100 + refined.level() * 10 + sub.level();
+    }
+
+    private static String internedConstant() {
+        return "interned";
+    }
+
+    public static int stringInternTest() {
+        String literal = "interned";
+        String built = new StringBuilder("inter").append("ned").toString();
+        int result = 0;
+        if (literal == internedConstant()) {
+            result += 1;
+        }
+        if (built != literal) {
+            result += 10;
+        }
+        if (built.intern() == literal) {
+            result += 100;
+        }
+        return result;
+    }
+
+    public static int primitiveArrayTest() {
+        byte[] bytes = new byte[] { (byte) 200, 1 };
+        short[] shorts = new short[] { (short) 40000 };
+        char[] chars = new char[] { (char) -1 };
+        long[] longs = new long[] { 5000000000L };
+        float[] floats = new float[] { 1.5f };
+        double[] doubles = new double[] { 0.5 };
+        boolean[] flags = new boolean[] { false, true };
+        // -56 + 1 - 25536 + 65535
+        int result = bytes[0] + bytes[1] + shorts[0] + chars[0];
+        if (longs[0] == 5000000000L) {
+            result += 100000;
+        }
+        if (floats[0] == 1.5f && doubles[0] == 0.5) {
+            result += 200000;
+        }
+        if (!flags[0] && flags[1]) {
+            result += 400000;
+        }
+        return result;
+    }
+
+    public static int stringIntrinsicsTest() {
+        String hello = "Hello World";
+        int result = 0;
+        if (hello.equals(new StringBuilder("Hello").append(' ').append("World").toString())
+            && !hello.equals("Hello") && !hello.equals(null) && !hello.equals(new Object())) {
+            result |= 1;
+        }
+        if (hello.indexOf('o') == 4 && hello.indexOf('o', 5) == 7 && hello.indexOf('x') == -1
+            && hello.indexOf('H', -3) == 0 && hello.indexOf('d', 11) == -1) {
+            result |= 2;
+        }
+        if (hello.charAt(6) == 'W') {
+            result |= 4;
+        }
+        if ("abc".compareTo("abd") == -1 && "abc".compareTo("ab") == 1 && "b".compareTo("a") == 1 && hello.compareTo(hello) == 0) {
+            result |= 8;
+        }
+        StringBuilder builder = new StringBuilder();
+        for (int i = 0; i < 100; i++) {
+            builder.append((char) ('a' + i % 26));
+        }
+        builder.append((String) null);
+        String built = builder.toString();
+        if (built.length() == 104 && built.charAt(26) == 'a' && built.endsWith("null")) {
+            result |= 16;
+        }
+        if ("\uD83D\uDE00x".indexOf(0x1F600) == 0 && "x\uD83D\uDE00".indexOf(0x1F600) == 1) {
+            result |= 32;
+        }
+        if (hello.hashCode() == -862545276) {
+            result |= 64;
+        }
+        return result;
+    }
+
+    private static int tableSwitch(int value) {
+        switch (value) {
+            case -1: return 10;
+            case 0: return 20;
+            case 2: return 30;
+            case 3: return 40;
+            default: return 1;
+        }
+    }
+
+    public static int tableSwitchTest() {
+        // 10 + 20 + 1 + 30 + 40 + 1 + 1 + 1
+        return tableSwitch(-1) + tableSwitch(0) + tableSwitch(1) + tableSwitch(2) + tableSwitch(3)
+            + tableSwitch(4) + tableSwitch(-2) + tableSwitch(Integer.MIN_VALUE);
+    }
+
+    interface Limits {
+        // Not a compile time constant, so it is read with getstatic
+        int[] MAX = { 7 };
+    }
+
+    static class BoundedRect extends Rect implements Limits {
+    }
+
+    public static int interfaceStaticFieldTest() {
+        // Referenced through the implementing class
+        return BoundedRect.MAX[0] + 1;
+    }
+
     private static float toFloat(int v){
         return (float)v;
     }
@@ -79,6 +79,11 @@ public:
         return start;
     }
     
+    /** Offset of the next byte to read. */
+    size_t position() const {
+        return mPos;
+    }
+
     size_t rest() const {
         return mSize - mPos;
     }
@@ -1,18 +1,22 @@
 #pragma once
 #include "types.h"
 
+/** Bytes of a class file, e.g. the code of a method. Does not own them, see ClassFile::source. */
 struct ByteRange {
+    typedef const uint8_t* Iterator;
+
     ByteRange(){
-        this->end = this->begin;
+        this->begin = nullptr;
+        this->end = nullptr;
     }
 
-    ByteRange(std::vector<uint8_t>::const_iterator begin, std::vector<uint8_t>::const_iterator end) {
+    ByteRange(Iterator begin, Iterator end) {
         this->begin = begin;
         this->end = end;
     }
 
-    ByteRange(const std::vector<uint8_t>& vector, size_t start, size_t length){
-        this->begin = vector.begin() + start;
+    ByteRange(const uint8_t* data, size_t start, size_t length){
+        this->begin = data + start;
         this->end = this->begin + length;
     }
 
@@ -46,48 +50,48 @@ struct ByteRange {
         return fetchUint16(begin + pos);
     }
 
-    uint16_t fetchUint16(std::vector<uint8_t>::const_iterator pos) const {
+    uint16_t fetchUint16(Iterator pos) const {
         if (pos + 2 > end){
             throw std::invalid_argument("Out of index");
         }
-        return ntohs(*reinterpret_cast<const uint16_t*> (&(*(pos))));
+        return ntohs(*reinterpret_cast<const uint16_t*> (pos));
     }
 
-    int8_t fetchInt8(std::vector<uint8_t>::const_iterator pos) const {
+    int8_t fetchInt8(Iterator pos) const {
         if (pos + 1 > end){
             throw std::invalid_argument("Out of index");
         }
-        return *reinterpret_cast<const int8_t*> (&(*(pos)));
+        return *reinterpret_cast<const int8_t*> (pos);
     }
 
-    int16_t fetchInt16(std::vector<uint8_t>::const_iterator pos) const {
+    int16_t fetchInt16(Iterator pos) const {
         if (pos + 2 > end){
             throw std::invalid_argument("Out of index");
         }
-        return ntohs(*reinterpret_cast<const int16_t*> (&(*(pos))));
+        return ntohs(*reinterpret_cast<const int16_t*> (pos));
     }
 
-    uint32_t fetchUint32(std::vector<uint8_t>::const_iterator pos) const {
+    uint32_t fetchUint32(Iterator pos) const {
         if (pos + 4 > end){
             throw std::invalid_argument("Out of index");
         }
-        return ntohl(*reinterpret_cast<const uint32_t*> (&(*(pos))));
+        return ntohl(*reinterpret_cast<const uint32_t*> (pos));
     }
 
-    int32_t fetchInt32(std::vector<uint8_t>::const_iterator pos) const {
+    int32_t fetchInt32(Iterator pos) const {
         if (pos + 4 > end){
             throw std::invalid_argument("Out of index");
         }
-        return ntohl(*reinterpret_cast<const int32_t*> (&(*(pos))));
+        return ntohl(*reinterpret_cast<const int32_t*> (pos));
     }
 
-    uint8_t fetchUint8(std::vector<uint8_t>::const_iterator pos) const {
+    uint8_t fetchUint8(Iterator pos) const {
         if (pos + 1 > end){
             throw std::invalid_argument("Out of index");
         }
         return *pos;
     }
 
-    std::vector<uint8_t>::const_iterator begin;
-    std::vector<uint8_t>::const_iterator end;
+    Iterator begin;
+    Iterator end;
 };
@@ -0,0 +1,39 @@
+#pragma once
+#include "types.h"
+#include <boost/iostreams/device/mapped_file.hpp>
+
+/** Read only bytes together with a reference to their owner (a ByteArray, a mapped jar, ...),
+    which keeps them alive as long as the view exists. */
+struct ByteView {
+    ByteView() {}
+
+    ByteView(const uint8_t* data, size_t size, const std::shared_ptr<const void>& owner)
+        : data(data), size(size), owner(owner) {}
+
+    /** Views a whole ByteArray. */
+    ByteView(const ByteArrayPtr& bytes)
+        : data(bytes->data()), size(bytes->size()), owner(bytes) {}
+
+    /** Maps a file read only, throws std::invalid_argument if that fails. */
+    static ByteView mapFile(const std::string& path) {
+        boost::iostreams::mapped_file_params params;
+        params.path = path;
+        params.flags = boost::iostreams::mapped_file_base::readonly;
+        auto mapping = std::make_shared<boost::iostreams::mapped_file_source>();
+        try {
+            mapping->open(params);
+        } catch (std::exception& e){
+            throw std::invalid_argument("Could not map " + path + ": " + e.what());
+        }
+        return ByteView(reinterpret_cast<const uint8_t*>(mapping->data()), mapping->size(), mapping);
+    }
+
+    explicit operator bool() const { return data != nullptr; }
+
+    const uint8_t* begin() const { return data; }
+    const uint8_t* end() const { return data + size; }
+
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    std::shared_ptr<const void> owner;
+};
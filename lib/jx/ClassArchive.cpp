@@ -0,0 +1,154 @@
+#include "ClassArchive.h"
+#include <cstring>
+#include <fstream>
+#include <boost/filesystem.hpp>
+
+namespace {
+
+const char Magic[8] = { 'J', 'X', 'C', 'D', 'S', 0, 0, 1 };
+
+template <class T> void put(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+}
+
+JarStamp JarStamp::of(const std::string& path) {
+    JarStamp result;
+    result.path = path;
+    boost::system::error_code error;
+    result.size = boost::filesystem::file_size(path, error);
+    if (!error){
+        result.modificationTime = boost::filesystem::last_write_time(path, error);
+    }
+    if (error){
+        result.size = 0;
+        result.modificationTime = 0;
+    }
+    return result;
+}
+
+ClassArchive::ClassArchive(const std::string& path) : mPath(path) {
+    boost::iostreams::mapped_file_params params;
+    params.path = path;
+    params.flags = boost::iostreams::mapped_file_base::readonly;
+    try {
+        mMappedFile.open(params);
+    } catch (std::exception& e){
+        throw std::invalid_argument("Could not map class archive " + path + ": " + e.what());
+    }
+    mData = reinterpret_cast<const uint8_t*>(mMappedFile.data());
+    mSize = mMappedFile.size();
+
+    size_t pos = 0;
+    auto read = [this, &pos](void* target, size_t length) {
+        checkRange(pos, length);
+        std::memcpy(target, mData + pos, length);
+        pos += length;
+    };
+    char magic[sizeof(Magic)];
+    read(magic, sizeof(magic));
+    if (std::memcmp(magic, Magic, sizeof(Magic)) != 0){
+        throw std::invalid_argument(path + " is no class archive of this version");
+    }
+    uint32_t sourceCount = 0;
+    uint32_t classCount = 0;
+    read(&sourceCount, sizeof(sourceCount));
+    read(&classCount, sizeof(classCount));
+    for (uint32_t i = 0; i < sourceCount; i++){
+        uint32_t length = 0;
+        read(&length, sizeof(length));
+        checkRange(pos, length);
+        JarStamp stamp;
+        stamp.path.assign(reinterpret_cast<const char*>(mData + pos), length);
+        pos += length;
+        read(&stamp.size, sizeof(stamp.size));
+        read(&stamp.modificationTime, sizeof(stamp.modificationTime));
+        mSources.push_back(stamp);
+    }
+    mIndexOffset = (pos + sizeof(uint32_t) - 1) / sizeof(uint32_t) * sizeof(uint32_t);
+    mClassCount = classCount;
+    checkRange(mIndexOffset, (uint64_t) mClassCount * sizeof(IndexEntry));
+    for (size_t i = 0; i < mClassCount; i++){
+        const IndexEntry& e = entry(i);
+        checkRange(e.nameOffset, e.nameLength);
+        checkRange(e.dataOffset, e.dataLength);
+    }
+}
+
+void ClassArchive::checkRange(uint64_t offset, uint64_t length) const {
+    if (offset + length > mSize){
+        throw std::invalid_argument("Class archive " + mPath + " is truncated");
+    }
+}
+
+const ClassArchive::IndexEntry& ClassArchive::entry(size_t index) const {
+    // The index starts 4 byte aligned, see write
+    return reinterpret_cast<const IndexEntry*>(mData + mIndexOffset)[index];
+}
+
+bool ClassArchive::find(const std::string& name, const uint8_t*& data, size_t& size) const {
+    size_t low = 0;
+    size_t high = mClassCount;
+    while (low < high){
+        size_t middle = (low + high) / 2;
+        const IndexEntry& e = entry(middle);
+        int compared = name.compare(0, std::string::npos, reinterpret_cast<const char*>(mData + e.nameOffset), e.nameLength);
+        if (compared == 0){
+            data = mData + e.dataOffset;
+            size = e.dataLength;
+            return true;
+        }
+        if (compared < 0){
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+    return false;
+}
+
+void ClassArchive::write(const std::string& path, const std::vector<JarStamp>& sources, const std::map<std::string, ByteArrayPtr>& classes) {
+    std::ofstream out (path.c_str(), std::ios::binary | std::ios::trunc);
+    out.write(Magic, sizeof(Magic));
+    put(out, (uint32_t) sources.size());
+    put(out, (uint32_t) classes.size());
+    size_t headerSize = sizeof(Magic) + 2 * sizeof(uint32_t);
+    for (const JarStamp& source : sources){
+        put(out, (uint32_t) source.path.size());
+        out.write(source.path.data(), source.path.size());
+        put(out, source.size);
+        put(out, source.modificationTime);
+        headerSize += sizeof(uint32_t) + source.path.size() + sizeof(source.size) + sizeof(source.modificationTime);
+    }
+    // Pad, so that the index can be read in place
+    while (headerSize % sizeof(uint32_t)){
+        out.put(0);
+        headerSize++;
+    }
+
+    // std::map is sorted by name already, as needed by find
+    uint64_t offset = headerSize + classes.size() * sizeof(IndexEntry);
+    std::vector<IndexEntry> index;
+    for (const auto& c : classes){
+        IndexEntry e;
+        e.nameOffset = (uint32_t) offset;
+        e.nameLength = (uint32_t) c.first.size();
+        offset += c.first.size();
+        e.dataOffset = (uint32_t) offset;
+        e.dataLength = (uint32_t) c.second->size();
+        offset += c.second->size();
+        index.push_back(e);
+    }
+    if (offset > UINT32_MAX){
+        throw std::invalid_argument("Class archive " + path + " would exceed 4GB");
+    }
+    out.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(IndexEntry));
+    for (const auto& c : classes){
+        out.write(c.first.data(), c.first.size());
+        out.write(reinterpret_cast<const char*>(c.second->data()), c.second->size());
+    }
+    if (!out){
+        throw std::invalid_argument("Could not write class archive " + path);
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include "types.h"
+
+/** Identifies the version of a jar the archived classes were taken from. */
+struct JarStamp {
+    std::string path;
+    uint64_t size = 0;
+    int64_t modificationTime = 0;
+
+    /** Stamp of the jar as it is on disk now. */
+    static JarStamp of(const std::string& path);
+
+    bool operator==(const JarStamp& other) const {
+        return path == other.path && size == other.size && modificationTime == other.modificationTime;
+    }
+};
+
+/** Class data sharing archive (like -Xshare of HotSpot): the class files a run loaded from jars,
+    stored in one file which is memory mapped read only. Classes are parsed straight from the
+    mapping, so jars (and their zip directories) are only opened for classes missing in the archive.
+
+    Layout, in native byte order (archives are not meant to be moved between machines):
+    magic, source count, class count, sources (path length, path, size, modification time),
+    class index sorted by name (name offset, name length, data offset, data length), names and class files. */
+class ClassArchive : boost::noncopyable {
+public:
+    /** Maps an archive, throws std::invalid_argument if it is not a valid archive. */
+    explicit ClassArchive(const std::string& path);
+
+    const std::string& path() const { return mPath; }
+
+    /** Jars the classes were loaded from, in class path order. */
+    const std::vector<JarStamp>& sources() const { return mSources; }
+
+    size_t classCount() const { return mClassCount; }
+
+    /** Finds the class file of a class (e.g. java/lang/Object), returns false if it is not archived. */
+    bool find(const std::string& name, const uint8_t*& data, size_t& size) const;
+
+    /** Writes an archive of the given class files by class name. */
+    static void write(const std::string& path, const std::vector<JarStamp>& sources, const std::map<std::string, ByteArrayPtr>& classes);
+
+private:
+    struct IndexEntry {
+        uint32_t nameOffset;
+        uint32_t nameLength;
+        uint32_t dataOffset;
+        uint32_t dataLength;
+    };
+
+    const IndexEntry& entry(size_t index) const;
+    /** Checks that a range lies inside of the mapping. */
+    void checkRange(uint64_t offset, uint64_t length) const;
+
+    std::string mPath;
+    boost::iostreams::mapped_file_source mMappedFile;
+    const uint8_t* mData = nullptr;
+    size_t mSize = 0;
+    std::vector<JarStamp> mSources;
+    size_t mClassCount = 0;
+    size_t mIndexOffset = 0;
+};
@@ -3,11 +3,21 @@
 #include "Util.h"
 #include <netinet/in.h>
 #include <iostream>
+#include <limits>
+#include <algorithm>
 #include "DescriptorParser.h"
 #include "Log.h"
 
 ClassFile ClassFile::parse(BinaryReader & reader) {
+    size_t size = reader.rest();
+    const uint8_t* bytes = reader.readBytes(size);
+    return parse(ByteView(std::make_shared<ByteArray>(bytes, bytes + size)));
+}
+
+ClassFile ClassFile::parse(const ByteView& source) {
     ClassFile file;
+    file.mSource = source;
+    BinaryReader reader(source.data, source.size);
     file.parseFromReader(reader);
     return file;
 }
@@ -58,8 +68,10 @@ void ClassFile::parseFromReader(BinaryReader& reader) {
     reader.readInto(mHeader.methods_count);
     for (int i = 0; i < mHeader.methods_count; i++){
         MethodInfo methodInfo = parseMethodInfo(reader);
+        methodInfo.index = i;
         mMethodInfos.push_back(methodInfo);
     }
+    mPreparedMethods.resize(mMethodInfos.size());
     
     reader.readInto(mHeader.attributes_count);
     for (int i = 0; i < mHeader.attributes_count; i++){
@@ -72,24 +84,47 @@ void ClassFile::parseFromReader(BinaryReader& reader) {
         
     }
     
+    mResolvedReferences.resize(mConstants.size());
+
     ConstantEntry classConstant = mConstants[mHeader.this_class];
-    mName = getUtf8Constant(classConstant.nameIndex());
+    mName = symbol(classConstant.nameIndex());
 
+    static const Symbol* Code = Symbol::intern("Code");
     for (uint32_t i = 0; i < mConstants.size(); i++){
-        ConstantEntry entry = mConstants[i];
-        if (entry.tag == ConstantEntry::Utf8Tag){
-            if (getUtf8Constant(entry) == "Code"){
-                mCodeIndex = i;
-            }
+        const ConstantEntry& entry = mConstants[i];
+        if (entry.tag == ConstantEntry::Utf8Tag && symbol(entry) == Code){
+            mCodeIndex = i;
         }
     }
+    buildIndices();
+}
+
+void ClassFile::buildIndices() {
+    for (const auto& method: mMethodInfos){
+        const Symbol* name = symbol(method.nameIdx);
+        // The first declaration wins, like the former linear search
+        mMethodIndex.emplace(SymbolPair(name, symbol(method.descriptorIdx)), method.index);
+        mMethodNameIndex.emplace(name, method.index);
+    }
+    for (size_t i = 0; i < mFieldInfos.size(); i++){
+        const FieldInfo& info = mFieldInfos[i];
+        mFieldIndex.emplace(symbol(info.nameIdx), (uint16_t) i);
+
+        FieldInformation field;
+        field.descriptor = symbol(info.descriptorIdx);
+        field.name = symbol(info.nameIdx);
+        field.isStatic = (bool)(info.accessFlags & Flags::STATIC);
+        field.isPrivate = (bool)(info.accessFlags & Flags::PRIVATE);
+        mFields.push_back(field);
+    }
 }
 
 AttributeInfo ClassFile::parseAttributeInfo(BinaryReader& reader) {
     AttributeInfo attributeInfo;
     reader.readInto(attributeInfo.attributeNameIndex);
     reader.readInto(attributeInfo.attributeLength);
-    attributeInfo.byteIndex = reader.readBytesInto(mBytes, attributeInfo.attributeLength);
+    attributeInfo.byteIndex = reader.position();
+    reader.readBytes(attributeInfo.attributeLength);
     return attributeInfo;
 }
 
@@ -119,15 +154,10 @@ ConstantEntry ClassFile::parseConstantEntry(BinaryReader& reader){
             uint16_t length;
             reader.readInto(length);
             
-            uint32_t idx = reader.readBytesInto(mBytes, length);
-            
-            uint32_t length4 = length;
-            
-            memcpy(constant.bytes, &idx, 4);
-            memcpy(constant.bytes + 4, &length4, 4);
-
-            // std::string utf8String = getUtf8Constant(constant);
-            // std::cout << "Parsed string " << utf8String << " len " << length << std::endl;
+            const uint8_t* bytes = reader.readBytes(length);
+            // TODO: JVM spec requires much more UTF8 processing
+            const Symbol* symbol = Symbol::intern(reinterpret_cast<const char*>(bytes), length);
+            memcpy(constant.bytes, &symbol, sizeof(symbol));
 
             break;
         }
@@ -173,24 +203,16 @@ template<class T, class N> void dumpLine(std::ostream& stream, const N& name, co
     stream << "  " << name << "\t" << v << std::endl;
 }
 
-std::string ClassFile::getUtf8Constant(uint16_t idx) const {
-    ConstantEntry entry = mConstants.at(idx);
-    return getUtf8Constant(entry);
+const Symbol* ClassFile::symbol(uint16_t idx) const {
+    return symbol(mConstants.at(idx));
 }
 
-std::string ClassFile::getUtf8Constant(const ConstantEntry& entry) const {
+const Symbol* ClassFile::symbol(const ConstantEntry& entry) const {
     if (entry.tag != ConstantEntry::Utf8Tag){
         throw std::invalid_argument("Argument is not referring to UTF8 cosntant");
     }
-    uint32_t byteIndex;
-    uint32_t length;
-    
-    memcpy(&byteIndex, entry.bytes, 4);
-    memcpy(&length, entry.bytes + 4, 4);
-    
-    const uint8_t * bytes = &mBytes[byteIndex];
-    // TODO: JVM spec requires much more UTF8 processing
-    std::string result (reinterpret_cast<const char*>(bytes), length);
+    const Symbol* result;
+    memcpy(&result, entry.bytes, sizeof(result));
     return result;
 }
 
@@ -231,7 +253,7 @@ void ClassFile::dump(std::ostream &stream) const {
     for (auto& attribute: mAttributeEntries){
         dumpLine(stream, "  Attribute ", toString(attribute));
     }
-    dumpLine(stream, "Binary size", mBytes.size());
+    dumpLine(stream, "Binary size", mSource.size);
 }
 
 std::string ClassFile::toString(const ConstantEntry& entry) const {
@@ -295,37 +317,47 @@ boost::optional<MethodInfo> ClassFile::clinit() const {
 }
 
 boost::optional<MethodInfo> ClassFile::methodWithName(const std::string& searchedName, int requiredFlags) const {
-    for (auto i = mMethodInfos.begin(); i != mMethodInfos.end(); i++){
-        const auto & mi = *i;
-        if (requiredFlags == 0 || (mi.accessFlags & requiredFlags)) {
-            auto name = getUtf8Constant(mi.nameIdx);
-            if (name == searchedName) {
-                return boost::optional<MethodInfo>(mi);
-            }
+    const Symbol* searched = Symbol::find(searchedName);
+    if (!searched){
+        return boost::optional<MethodInfo>();
+    }
+    // Overloads are not ordered in the index, take the first declared one
+    const MethodInfo* found = nullptr;
+    auto range = mMethodNameIndex.equal_range(searched);
+    for (auto i = range.first; i != range.second; i++){
+        const MethodInfo& mi = mMethodInfos[i->second];
+        if ((requiredFlags == 0 || (mi.accessFlags & requiredFlags)) && (!found || mi.index < found->index)) {
+            found = &mi;
         }
     }
-    return boost::optional<MethodInfo>();
+    return found ? boost::optional<MethodInfo>(*found) : boost::optional<MethodInfo>();
 }
 
 boost::optional<FieldInfo> ClassFile::fieldWithName(const std::string& searchedName) const {
-    for (auto i = mFieldInfos.begin(); i != mFieldInfos.end(); i++){
-        const auto & mi = *i;
-        auto name = getUtf8Constant(mi.nameIdx);
-        if (name == searchedName) {
-            return boost::optional<FieldInfo>(mi);
-        }
-    }
-    return boost::optional<FieldInfo>();
+    const FieldInfo * field = lookupField(searchedName);
+    return field ? boost::optional<FieldInfo>(*field) : boost::optional<FieldInfo>();
+}
+
+const FieldInfo* ClassFile::lookupField(const std::string& searchedName) const {
+    // Not interned: no class declares such a field
+    const Symbol* searched = Symbol::find(searchedName);
+    return searched ? lookupField(searched) : nullptr;
+}
+
+const FieldInfo* ClassFile::lookupField(const Symbol* searchedName) const {
+    auto i = mFieldIndex.find(searchedName);
+    return i == mFieldIndex.end() ? nullptr : &mFieldInfos[i->second];
 }
 
 
 boost::optional<MethodInfo> ClassFile::methodWithSignature(const MethodIdentifier& identifier) const {
-    for (const auto& method: mMethodInfos){
-        if (getUtf8Constant(method.nameIdx) == identifier.methodName && getUtf8Constant(method.descriptorIdx) == identifier.descriptor) {
-            return boost::optional<MethodInfo>(method);
-        }
-    }
-    return boost::optional<MethodInfo>();
+    const MethodInfo * method = lookupMethod(identifier);
+    return method ? boost::optional<MethodInfo>(*method) : boost::optional<MethodInfo>();
+}
+
+const MethodInfo* ClassFile::lookupMethod(const Symbol* name, const Symbol* descriptor) const {
+    auto i = mMethodIndex.find(SymbolPair(name, descriptor));
+    return i == mMethodIndex.end() ? nullptr : &mMethodInfos[i->second];
 }
 
 
@@ -334,11 +366,11 @@ CodeIdentifier ClassFile::codeForMethod(const MethodInfo& method) const {
         std::string methodName = getUtf8Constant(method.nameIdx);
         throw std::invalid_argument("Method " + name() + " " + methodName + " is native");
     }
-    logd("This class ",  name());
+    logt("This class ",  name());
     std::vector<AttributeInfo>::const_iterator i = method.attributes.begin();
-    logd("Code Index ", mCodeIndex);
+    logt("Code Index ", mCodeIndex);
     for (; i != method.attributes.end(); i++){
-        logd(" Attribute name index ", i->attributeNameIndex);
+        logt(" Attribute name index ", i->attributeNameIndex);
         if (i->attributeNameIndex == mCodeIndex){
             break;
         }
@@ -349,7 +381,7 @@ CodeIdentifier ClassFile::codeForMethod(const MethodInfo& method) const {
         throw std::invalid_argument("Method " + name() + " " + methodName + " has no code block, abstract?");
     }
     const AttributeInfo& attributeInfo = *i;
-    ByteRange range = ByteRange(mBytes, attributeInfo.byteIndex, attributeInfo.attributeLength);
+    ByteRange range = ByteRange(mSource.data, attributeInfo.byteIndex, attributeInfo.attributeLength);
     CodeIdentifier code;
     code.maxStack = range.readUint16();
     code.maxLocals = range.readUint16();
@@ -363,12 +395,25 @@ CodeIdentifier ClassFile::codeForMethod(const MethodInfo& method) const {
     return code;
 }
 
-std::string ClassFile::findClass(uint16_t index) const {
+const Symbol* ClassFile::classSymbol(uint16_t index) const {
     const auto& constant = mConstants[index];
     if (constant.tag != ConstantEntry::ClassTag){
         throw std::invalid_argument("Index doesn't refer to class entry");
     }
-    return getUtf8Constant(constant.nameIndex());
+    return symbol(constant.nameIndex());
+}
+
+std::vector<std::string> ClassFile::referencedClasses() const {
+    std::vector<std::string> result;
+    for (size_t i = 0; i < mConstants.size(); i++){
+        if (mConstants[i].tag == ConstantEntry::ClassTag){
+            const Symbol* name = symbol(mConstants[i].nameIndex());
+            if (name != mName && !name->str().empty() && name->str()[0] != '['){
+                result.push_back(name->str());
+            }
+        }
+    }
+    return result;
 }
 
 MethodIdentifier ClassFile::findMethod(uint16_t index) const {
@@ -380,9 +425,9 @@ MethodIdentifier ClassFile::findMethod(uint16_t index) const {
 
     const auto& classReferer = mConstants[constant.classIndex()];
     const auto& nameAndType = mConstants[constant.nameAndTypeIndex()];
-    identifier.methodName = getUtf8Constant(nameAndType.nameIndex());
-    identifier.descriptor = getUtf8Constant(nameAndType.descriptorIndex());
-    identifier.className = getUtf8Constant(classReferer.nameIndex());
+    identifier.methodName = symbol(nameAndType.nameIndex());
+    identifier.descriptor = symbol(nameAndType.descriptorIndex());
+    identifier.className = symbol(classReferer.nameIndex());
     return identifier;
 }
 
@@ -396,9 +441,9 @@ MethodIdentifier ClassFile::findInterfaceMethod(uint16_t index) const {
 
     const auto& classReferer = mConstants[constant.classIndex()];
     const auto& nameAndType = mConstants[constant.nameAndTypeIndex()];
-    identifier.methodName = getUtf8Constant(nameAndType.nameIndex());
-    identifier.descriptor = getUtf8Constant(nameAndType.descriptorIndex());
-    identifier.className = getUtf8Constant(classReferer.nameIndex());
+    identifier.methodName = symbol(nameAndType.nameIndex());
+    identifier.descriptor = symbol(nameAndType.descriptorIndex());
+    identifier.className = symbol(classReferer.nameIndex());
     return identifier;
 }
 
@@ -412,25 +457,205 @@ FieldRefIdentifier ClassFile::findFieldRefIdentifier(uint16_t index) const {
     const auto& classReferer = mConstants[constant.classIndex()];
     const auto& nameAndType = mConstants[constant.nameAndTypeIndex()];
 
-    identifier.className = getUtf8Constant(classReferer.nameIndex());
-    identifier.fieldName = getUtf8Constant(nameAndType.nameIndex());
-    identifier.descriptor = getUtf8Constant(nameAndType.descriptorIndex());
+    identifier.className = symbol(classReferer.nameIndex());
+    identifier.fieldName = symbol(nameAndType.nameIndex());
+    identifier.descriptor = symbol(nameAndType.descriptorIndex());
     return identifier;
 }
 
-std::vector<FieldInformation> ClassFile::fields() const {
-    std::vector<FieldInformation> result;
-    for (const auto& info: mFieldInfos){
-        FieldInformation returnInfo;
-        returnInfo.descriptor = getUtf8Constant(info.descriptorIdx);
-        returnInfo.name = getUtf8Constant(info.nameIdx);
-        returnInfo.isStatic = (bool)(info.accessFlags & Flags::STATIC);
-        returnInfo.isPrivate = (bool)(info.accessFlags & Flags::PRIVATE);
-        result.push_back(returnInfo);
+namespace {
+
+void collectInterfaces(const ClassFile* interface, std::vector<const ClassFile*>& result) {
+    if (std::find(result.begin(), result.end(), interface) != result.end()){
+        return;
+    }
+    result.push_back(interface);
+    for (const auto& superInterface : interface->interfaceFiles()){
+        collectInterfaces(superInterface.get(), result);
+    }
+}
+
+bool extendsInterface(const ClassFile* interface, const ClassFile* superInterface) {
+    for (const auto& direct : interface->interfaceFiles()){
+        if (direct.get() == superInterface || extendsInterface(direct.get(), superInterface)){
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+VirtualMethod ClassFile::selectDefaultMethod(const std::vector<const ClassFile*>& interfaces, const SymbolPair& key) {
+    std::vector<const ClassFile*> declaring;
+    for (const ClassFile* interface : interfaces){
+        if (interface->mInterfaceMethodIndex.count(key)){
+            declaring.push_back(interface);
+        }
+    }
+    // Like JVMS 5.4.3.3: the only non abstract method of the maximally specific interfaces
+    VirtualMethod result;
+    for (const ClassFile* interface : declaring){
+        bool overridden = std::any_of(declaring.begin(), declaring.end(), [interface](const ClassFile* other) {
+            return other != interface && extendsInterface(other, interface);
+        });
+        const MethodInfo* method = interface->mInterfaceMethods[interface->mInterfaceMethodIndex.at(key)];
+        if (overridden || (method->accessFlags & Flags::ABSTRACT)){
+            continue;
+        }
+        if (result.method){
+            return VirtualMethod();
+        }
+        result.clazz = const_cast<ClassFile*>(interface);
+        result.method = method;
     }
     return result;
 }
 
+void ClassFile::layoutMethods() {
+    static const Symbol* Init = Symbol::intern("<init>");
+    static const Symbol* ClassInit = Symbol::intern("<clinit>");
+    if (isInterface()){
+        for (const auto& method: mMethodInfos){
+            const Symbol* name = symbol(method.nameIdx);
+            if ((method.accessFlags & (Flags::STATIC | Flags::PRIVATE)) || name == ClassInit){
+                continue;
+            }
+            mInterfaceMethodIndex[SymbolPair(name, symbol(method.descriptorIdx))] = (uint16_t) mInterfaceMethods.size();
+            mInterfaceMethods.push_back(&method);
+        }
+        return;
+    }
+
+    ClassFilePtr superClass = mSuperClassFile.lock();
+    std::vector<const ClassFile*> interfaces;
+    if (superClass){
+        mVTable = superClass->mVTable;
+        mVTableIndex = superClass->mVTableIndex;
+        for (const auto& table : superClass->mInterfaceTables){
+            interfaces.push_back(table.interface);
+        }
+    }
+    auto addVirtualMethod = [this](const SymbolPair& key, const VirtualMethod& entry) {
+        if (mVTable.size() >= std::numeric_limits<uint16_t>::max()){
+            throw std::invalid_argument("Too many virtual methods in " + mName->str());
+        }
+        mVTableIndex[key] = (uint16_t) mVTable.size();
+        mVTable.push_back(entry);
+    };
+    for (const auto& method: mMethodInfos){
+        const Symbol* name = symbol(method.nameIdx);
+        if ((method.accessFlags & (Flags::STATIC | Flags::PRIVATE)) || name == Init || name == ClassInit){
+            continue;
+        }
+        VirtualMethod entry;
+        entry.clazz = this;
+        entry.method = &method;
+        SymbolPair key (name, symbol(method.descriptorIdx));
+        auto existing = mVTableIndex.find(key);
+        if (existing != mVTableIndex.end()){
+            // Override
+            mVTable[existing->second] = entry;
+        } else {
+            addVirtualMethod(key, entry);
+        }
+    }
+
+    for (const auto& interface : mInterfaceFiles){
+        collectInterfaces(interface.get(), interfaces);
+    }
+    // Default methods get vtable slots after the class' own methods, so that calls on class typed receivers
+    // dispatch by index as well. Inherited defaults are selected again, this class may implement more specific interfaces.
+    for (const ClassFile* interface : interfaces){
+        for (const MethodInfo* method : interface->mInterfaceMethods){
+            if (method->accessFlags & Flags::ABSTRACT){
+                continue;
+            }
+            SymbolPair key (interface->symbol(method->nameIdx), interface->symbol(method->descriptorIdx));
+            auto existing = mVTableIndex.find(key);
+            const ClassFile* owner = existing != mVTableIndex.end() ? mVTable[existing->second].clazz : nullptr;
+            if (owner && !owner->isInterface()){
+                // Methods of classes win over default methods
+                continue;
+            }
+            VirtualMethod entry = selectDefaultMethod(interfaces, key);
+            if (existing != mVTableIndex.end()){
+                mVTable[existing->second] = entry;
+            } else if (entry.method){
+                addVirtualMethod(key, entry);
+            }
+        }
+    }
+
+    // Interface tables are rebuilt, as methods may be overridden in this class
+    for (const ClassFile* interface : interfaces){
+        InterfaceTable table;
+        table.interface = interface;
+        for (const MethodInfo* method : interface->mInterfaceMethods){
+            VirtualMethod entry;
+            int index = vtableIndex(interface->symbol(method->nameIdx), interface->symbol(method->descriptorIdx));
+            if (index >= 0){
+                entry = mVTable[index];
+            }
+            table.methods.push_back(entry);
+        }
+        mInterfaceTables.push_back(table);
+    }
+}
+
+int ClassFile::vtableIndex(const Symbol* methodName, const Symbol* descriptor) const {
+    auto it = mVTableIndex.find(SymbolPair(methodName, descriptor));
+    return it == mVTableIndex.end() ? -1 : it->second;
+}
+
+int ClassFile::interfaceMethodIndex(const Symbol* methodName, const Symbol* descriptor) const {
+    auto it = mInterfaceMethodIndex.find(SymbolPair(methodName, descriptor));
+    return it == mInterfaceMethodIndex.end() ? -1 : it->second;
+}
+
+void ClassFile::layoutFields() {
+    ClassFilePtr superClass = mSuperClassFile.lock();
+    if (superClass){
+        mInstanceFields = superClass->instanceFields();
+        mInstancePrototype = superClass->instancePrototype();
+    }
+    for (auto& field: mFieldInfos){
+        if (field.accessFlags & Flags::STATIC){
+            continue;
+        }
+        const Symbol* key = symbol(field.nameIdx);
+        if (field.accessFlags & Flags::PRIVATE){
+            key = Symbol::intern(mName->str() + "__" + key->str());
+        }
+        DescriptorParser descriptorParser (getUtf8Constant(field.descriptorIdx));
+        field.slot = addSyntheticField(key, descriptorParser.type());
+    }
+}
+
+uint16_t ClassFile::addSyntheticField(const Symbol* key, VariableType type) {
+    if (mInstanceFields.size() >= std::numeric_limits<uint16_t>::max()){
+        throw std::invalid_argument("Too many fields in " + name());
+    }
+    mInstanceFields.push_back(InstanceField { key, type });
+    mInstancePrototype.push_back(Variable(type));
+    return (uint16_t) (mInstanceFields.size() - 1);
+}
+
+int ClassFile::instanceFieldSlot(const std::string& key) const {
+    // Not interned: no class has such a field
+    const Symbol* symbol = Symbol::find(key);
+    return symbol ? instanceFieldSlot(symbol) : -1;
+}
+
+int ClassFile::instanceFieldSlot(const Symbol* key) const {
+    // Search backwards, so that fields of subclasses shadow the ones of their parents
+    for (size_t i = mInstanceFields.size(); i > 0; i--){
+        if (mInstanceFields[i - 1].key == key){
+            return (int) (i - 1);
+        }
+    }
+    return -1;
+}
 
 std::string ClassFile::toString(const MethodInfo &entry) const {
     std::ostringstream stream;
@@ -3,10 +3,14 @@
 #include <string>
 #include <vector>
 #include <sstream>
+#include <unordered_map>
 #include "BinaryReader.h"
 #include "Util.h"
 #include <boost/optional.hpp>
 #include "ByteRange.h"
+#include "ByteView.h"
+#include "Symbol.h"
+#include "DescriptorParser.h"
 
 
 /* Main header of a class file. */
@@ -32,8 +36,7 @@ struct ConstantEntry {
     uint8_t bytes[8];
 
 
-    // Note: special meaning for UTF8, just saving index into mBytes into the first 4 bytes
-    // Length is saved in the next4 bytes, both in platform order
+    // Note: special meaning for UTF8, the interned Symbol pointer is saved in platform order
 
     static const int StartTag = 0; // Aritficial null entry, so that indexing start from 0
     static const int FillTag = 100; // Artificial fill entry for double-slot-taking entries.
@@ -125,11 +128,13 @@ struct ConstantEntry {
 struct AttributeInfo {
     uint16_t attributeNameIndex;
     uint32_t attributeLength;
-    // Start of the bytes
+    // Start of the bytes in the class file
     size_t byteIndex;
 };
 
 struct FieldInfo {
+    /** Index inside Object::fields, only for instance fields and after ClassFile::layoutFields. */
+    uint16_t slot = 0;
     uint16_t accessFlags;
     uint16_t nameIdx;
     uint16_t descriptorIdx;
@@ -158,6 +163,8 @@ namespace Flags {
 
 
 struct MethodInfo {
+    /** Position in the method table of the declaring class. */
+    uint16_t index;
     uint16_t accessFlags;
     uint16_t nameIdx;
     uint16_t descriptorIdx;
@@ -204,42 +211,103 @@ static std::string accessRestrictionToString(uint16_t access){
 }
 
 struct MethodIdentifier {
-    std::string className;
-    std::string methodName;
-    std::string descriptor;
+    const Symbol* className = nullptr;
+    const Symbol* methodName = nullptr;
+    const Symbol* descriptor = nullptr;
 
-    std::string toString() const { return descriptor + " " + className + " " + methodName;  }
+    std::string toString() const { return descriptor->str() + " " + className->str() + " " + methodName->str();  }
 };
 
 struct FieldRefIdentifier {
-    std::string className;
-    std::string descriptor;
-    std::string fieldName;
+    const Symbol* className = nullptr;
+    const Symbol* descriptor = nullptr;
+    const Symbol* fieldName = nullptr;
 
-    std::string toString() const { return descriptor + " " + className + " " + fieldName; }
+    std::string toString() const { return descriptor->str() + " " + className->str() + " " + fieldName->str(); }
 };
 
 struct FieldInformation {
-    std::string descriptor;
-    std::string name;
+    const Symbol* descriptor = nullptr;
+    const Symbol* name = nullptr;
     bool isPrivate = false;
     bool isStatic = false;
 };
 
 
+/** An instance field inside the object layout of a class. */
+struct InstanceField {
+    /** Field name, private fields are prefixed with their class, e.g. java/lang/Thread__priority. */
+    const Symbol* key;
+    VariableType type;
+};
+
+
 class ClassFile;
 typedef std::shared_ptr<ClassFile> ClassFilePtr;
 typedef std::weak_ptr<ClassFile> ClassFileWeakPtr;
 
+/** Target of a virtual or interface call. */
+struct VirtualMethod {
+    ClassFile* clazz = nullptr;
+    const MethodInfo* method = nullptr;
+};
+
+/** Implementations of the methods of an interface, indexed like ClassFile::interfaceMethodIndex of the interface. */
+struct InterfaceTable {
+    const ClassFile* interface = nullptr;
+    std::vector<VirtualMethod> methods;
+};
+
+// Defined by the interpreter
+struct PreparedMethod;
+
+/** A method or field reference from the constant pool after linking.
+    Filled lazily by the interpreter on first execution of the referencing op code. */
+struct ResolvedReference {
+    ResolvedReference(const std::string& descriptor) : descriptor(descriptor) {}
+
+    /** Initialized class declaring the method/field, not set for virtual dispatch. */
+    const ClassFile* clazz = nullptr;
+    /** Target method for static and special invocations. */
+    const MethodInfo* method = nullptr;
+    /** Referenced method, virtual dispatch happens on the receiver. */
+    MethodIdentifier methodIdentifier;
+    DescriptorParser descriptor;
+
+    /** Key of an instance field, for diagnostics. */
+    const Symbol* fieldKey = nullptr;
+    /** Slot of an instance field inside Object::fields. */
+    uint16_t fieldSlot = 0;
+
+    /** Index into the vtable of the receiver, -1 if not dispatched via vtable. */
+    int32_t vtableIndex = -1;
+    /** Interface declaring the method for interface calls (itable dispatch). */
+    const ClassFile* interfaceClass = nullptr;
+    int32_t itableIndex = -1;
+    /** Storage of a static field. */
+    Variable* staticField = nullptr;
+    /** Interned java/lang/String of a string constant. */
+    Object* string = nullptr;
+};
 
-class ClassFile {
+
+class ClassFile : public std::enable_shared_from_this<ClassFile> {
 public:
+    /** Parses the rest of the reader, copying it once. */
     static ClassFile parse(BinaryReader& reader);
 
+    /** Parses a class file without copying it: constants, attributes and code point into
+        the source, which is kept alive by the ClassFile (e.g. a mapped ClassArchive or jar). */
+    static ClassFile parse(const ByteView& source);
+
+    /** The class file this was parsed from. */
+    const ByteView& source() const { return mSource; }
+
     void dump(std::ostream&stream) const;
 
     /** Full qualified name of  the class. */
-    const std::string& name() const { return mName; }
+    const std::string& name() const { return mName->str(); }
+    const Symbol* nameSymbol() const { return mName; }
 
     /** Finds the main method. */
     boost::optional<MethodInfo> mainMethod() const;
@@ -256,15 +324,29 @@ public:
     /** Finds a method with a given identifier, doesn't look for the class! */
     boost::optional<MethodInfo> methodWithSignature(const MethodIdentifier& identifier) const;
 
+    /** Like methodWithSignature, but points into the method table of this class. */
+    const MethodInfo* lookupMethod(const MethodIdentifier& identifier) const {
+        return lookupMethod(identifier.methodName, identifier.descriptor);
+    }
+    const MethodInfo* lookupMethod(const Symbol* name, const Symbol* descriptor) const;
+
+    /** Like fieldWithName, but points into the field table of this class. */
+    const FieldInfo* lookupField(const std::string& name) const;
+    const FieldInfo* lookupField(const Symbol* name) const;
+
     /** Returns the code block for a method. */
     CodeIdentifier codeForMethod(const MethodInfo& method) const;
 
-    std::string descriptorForMethod(const MethodInfo& method) const {
+    const std::string& descriptorForMethod(const MethodInfo& method) const {
         return getUtf8Constant(method.descriptorIdx);
     }
 
+    bool isInterface() const { return (bool)(mHeader.access_flags & Flags::INTERFACE); }
+
     /** Find a class from the constant pool, e.g. for loading. */
-    std::string findClass(uint16_t index) const;
+    std::string findClass(uint16_t index) const { return classSymbol(index)->str(); }
+    /** Like findClass, returns the interned name. */
+    const Symbol* classSymbol(uint16_t index) const;
 
     boost::optional<std::string> superClass() const {
         return mHeader.super_class == 0 ? boost::optional<std::string> () : boost::optional<std::string>(findClass(mHeader.super_class));
@@ -278,8 +360,11 @@ public:
         return result;
     }
 
+    /** Classes referenced by the constant pool (without array classes and this class), e.g. for prefetching. */
+    std::vector<std::string> referencedClasses() const;
+
     /** Find a method name. */
-    std::string methodName(const MethodInfo& method) const {
+    const std::string& methodName(const MethodInfo& method) const {
         return getUtf8Constant(method.nameIdx);
     }
 
@@ -292,29 +377,102 @@ public:
     /** Resolve a field ref. */
     FieldRefIdentifier findFieldRefIdentifier(uint16_t index) const;
 
-    /** Returns the static fields of this class. */
-    std::vector<FieldInformation> fields() const;
+    /** Returns the fields declared by this class, built once while parsing. */
+    const std::vector<FieldInformation>& fields() const { return mFields; }
 
     const ConstantEntry & constantEntry(uint16_t index) const {
         return mConstants[index];
     }
 
-    std::string getUtf8Constant(uint16_t idx) const;
-    std::string getUtf8Constant(const ConstantEntry& entry) const;
+    const std::string& getUtf8Constant(uint16_t idx) const { return symbol(idx)->str(); }
+    const std::string& getUtf8Constant(const ConstantEntry& entry) const { return symbol(entry)->str(); }
+
+    /** The interned content of an UTF8 constant. */
+    const Symbol* symbol(uint16_t idx) const;
+    const Symbol* symbol(const ConstantEntry& entry) const;
 
     void setSuperClassFile (const ClassFileWeakPtr& s) { mSuperClassFile = s; }
     ClassFileWeakPtr superClassFile() const { return mSuperClassFile; }
 
+    void setInterfaceFiles(const std::vector<ClassFilePtr>& interfaces) { mInterfaceFiles = interfaces; }
+    /** Loaded direct super interfaces. */
+    const std::vector<ClassFilePtr>& interfaceFiles() const { return mInterfaceFiles; }
+
+    /** Builds vtable and interface tables, super class and interfaces must already be laid out. */
+    void layoutMethods();
+
+    /** Virtual methods, inherited ones keep the index of the super class. */
+    const std::vector<VirtualMethod>& vtable() const { return mVTable; }
+
+    /** Index of a virtual method with given name and descriptor, -1 if not found. */
+    int vtableIndex(const Symbol* methodName, const Symbol* descriptor) const;
+
+    /** For interfaces: index of a declared method inside the interface tables, -1 if not found. */
+    int interfaceMethodIndex(const Symbol* methodName, const Symbol* descriptor) const;
+
+    /** Implementation of an interface method, null if the class doesn't implement the interface. */
+    const VirtualMethod* interfaceMethod(const ClassFile* interface, size_t index) const {
+        for (const InterfaceTable& table : mInterfaceTables){
+            if (table.interface == interface){
+                return &table.methods[index];
+            }
+        }
+        return nullptr;
+    }
+
+    /** Assigns slots to the instance fields, inherited fields come first.
+        The super class must already be laid out. */
+    void layoutFields();
+
+    /** Appends an instance field not declared in the class file (e.g. VM internal state), returns its slot. */
+    uint16_t addSyntheticField(const Symbol* key, VariableType type);
+
+    /** All instance fields of an object of this class, indexed by slot. */
+    const std::vector<InstanceField>& instanceFields() const { return mInstanceFields; }
+
+    /** Initial field values of a new instance. */
+    const std::vector<Variable>& instancePrototype() const { return mInstancePrototype; }
+
+    /** Finds the slot of an instance field by its key, -1 if not found. Linear, for rare lookups only. */
+    int instanceFieldSlot(const std::string& key) const;
+    int instanceFieldSlot(const Symbol* key) const;
+
+    /** Returns the link information of a constant pool entry, or null if not resolved yet.
+        Note: it's a cache, so it can also be completed on const classes. */
+    ResolvedReference* resolvedReference(uint16_t index) const {
+        return mResolvedReferences[index].get();
+    }
+
+    /** Returns the prepared form of a method (see Interpreter), or null if not prepared yet. */
+    PreparedMethod* preparedMethod(const MethodInfo& method) const {
+        return mPreparedMethods[method.index].get();
+    }
+
+    PreparedMethod* setPreparedMethod(const MethodInfo& method, const std::shared_ptr<PreparedMethod>& prepared) const {
+        mPreparedMethods[method.index] = prepared;
+        return prepared.get();
+    }
+
+    /** Saves link information of a constant pool entry. */
+    ResolvedReference* setResolvedReference(uint16_t index, std::unique_ptr<ResolvedReference> reference) const {
+        mResolvedReferences[index] = std::move(reference);
+        return mResolvedReferences[index].get();
+    }
+
 private:
 
     void parseFromReader(BinaryReader& reader);
-    /** Parses an attribute info. Note, it will save bytes into mBytes, but not add
-     add the attribute entries to mAttributeEntries, as there are multiple uses of it. */
+    /** Parses an attribute info. Note, it will not add the attribute entries
+     to mAttributeEntries, as there are multiple uses of it. */
     AttributeInfo parseAttributeInfo(BinaryReader& reader);
     /** Parses constant entry, but doesn't add to inner tables. */
     ConstantEntry parseConstantEntry(BinaryReader& reader);
     FieldInfo parseFieldInfo(BinaryReader& reader);
     MethodInfo parseMethodInfo(BinaryReader& reader);
+    /** Fills the lookup tables of methods and fields. */
+    void buildIndices();
+    /** Default method of the maximally specific interfaces declaring a method, empty if there is none or it is ambiguous. */
+    static VirtualMethod selectDefaultMethod(const std::vector<const ClassFile*>& interfaces, const SymbolPair& key);
     
     ClassFile() {
     }
@@ -326,12 +484,18 @@ private:
     std::vector<FieldInfo> mFieldInfos;
     std::vector<MethodInfo> mMethodInfos;
     std::vector<AttributeInfo> mAttributeEntries;
+
+    // Built by parse: methods by name and descriptor, methods and fields by name (indices into the infos)
+    std::unordered_map<SymbolPair, uint16_t, hash::SymbolHash> mMethodIndex;
+    std::unordered_multimap<const Symbol*, uint16_t, hash::SymbolHash> mMethodNameIndex;
+    std::unordered_map<const Symbol*, uint16_t, hash::SymbolHash> mFieldIndex;
+    std::vector<FieldInformation> mFields;
     
     
-    // Contains the non-header bytes
-    std::vector<uint8_t> mBytes;
+    // The whole class file, UTF8 constants and attributes point into it
+    ByteView mSource;
     
-    std::string mName;
+    const Symbol* mName = nullptr;
 
     /** Index for the UTF8 Word for 'Code'. */
     uint32_t mCodeIndex;
@@ -341,4 +505,21 @@ private:
     std::string toString(const AttributeInfo& entry) const;
 
     ClassFileWeakPtr mSuperClassFile;
+
+    std::vector<ClassFilePtr> mInterfaceFiles;
+    std::vector<VirtualMethod> mVTable;
+    // Key is method name and descriptor
+    std::unordered_map<SymbolPair, uint16_t, hash::SymbolHash> mVTableIndex;
+    // For interfaces, declared methods
+    std::vector<const MethodInfo*> mInterfaceMethods;
+    std::unordered_map<SymbolPair, uint16_t, hash::SymbolHash> mInterfaceMethodIndex;
+    std::vector<InterfaceTable> mInterfaceTables;
+
+    std::vector<InstanceField> mInstanceFields;
+    std::vector<Variable> mInstancePrototype;
+
+    // Indexed like mConstants
+    mutable std::vector<std::unique_ptr<ResolvedReference>> mResolvedReferences;
+    // Indexed like mMethodInfos
+    mutable std::vector<std::shared_ptr<PreparedMethod>> mPreparedMethods;
 };
@@ -11,53 +11,113 @@ std::string suffix (const std::string& string) {
 }
 
 std::shared_ptr<ClassFile> ClassLoader::loadByFile(const std::string& name) {
-    BinaryReader reader(name);
-    // TODO: Memory
-    auto ptr = std::make_shared<ClassFile>(ClassFile::parse(reader));
-    if (mClasses.count(ptr->name()) > 0){
+    auto ptr = std::make_shared<ClassFile>(ClassFile::parse(ByteView::mapFile(name)));
+    if (mClasses.count(ptr->nameSymbol()) > 0){
         logi("Will overwrite existing instance of ", ptr->name());
     }
-    mClasses[ptr->name()] = ptr;
-    logi("Loaded ", ptr->name());
     // ptr->dump(std::cout);
-
-    fillSuperClasses(*ptr);
+    define(ptr, name);
     return ptr;
 }
 
 
 std::shared_ptr<ClassFile> ClassLoader::loadByName(const std::string& name){
-    const auto i = mClasses.find(name);
+    return loadByName(Symbol::intern(name));
+}
+
+std::shared_ptr<ClassFile> ClassLoader::loadByName(const Symbol* symbol){
+    const auto i = mClasses.find(symbol);
     if (i != mClasses.end()){
         return i->second;
     }
+    const std::string& name = symbol->str();
 
     for (const auto& path : mPaths){
         // TODO
     }
 
-    for (const auto& zipSource: mJars){
-        ByteArrayPtr bytes = zipSource->findClassSource(name + ".class");
+    ClassPrefetcher::Prefetched prefetched;
+    if (mPrefetcher && mPrefetcher->take(name, prefetched)){
+        if (mRecording && prefetched.bytes){
+            mRecordedClasses[name] = std::make_shared<ByteArray>(prefetched.bytes.begin(), prefetched.bytes.end());
+        }
+        define(prefetched.classFile, prefetched.origin);
+        return prefetched.classFile;
+    }
+
+    if (mMissingClasses.count(symbol)){
+        throw std::invalid_argument("Could not find class " + name);
+    }
+
+    const uint8_t* archived = nullptr;
+    size_t archivedSize = 0;
+    if (mArchive && mArchive->find(name, archived, archivedSize)){
+        // The class keeps the archive mapped
+        auto classFile = std::make_shared<ClassFile>(ClassFile::parse(ByteView(archived, archivedSize, mArchive)));
+        define(classFile, mArchive->path());
+        return classFile;
+    }
+
+    for (const auto& jar: mJars){
+        ByteView bytes = jar->find(name + ".class");
         if (bytes){
-            BinaryReader reader(*bytes);
-            // TODO Memory
-            auto classFile = std::make_shared<ClassFile>(ClassFile::parse(reader));
-            mClasses[name] = classFile;
-            logi("Loaded ", name, " from ", zipSource->path());
+            auto classFile = std::make_shared<ClassFile>(ClassFile::parse(bytes));
+            if (mRecording){
+                mRecordedClasses[name] = std::make_shared<ByteArray>(bytes.begin(), bytes.end());
+            }
             // classFile->dump(std::cout);
-            fillSuperClasses(*classFile);
+            define(classFile, jar->path());
             return classFile;
         }
     }
 
+    mMissingClasses.insert(symbol);
 
     throw std::invalid_argument("Could not find class " + name);
 }
 
+void ClassLoader::define(const ClassFilePtr& classFile, const std::string& origin) {
+    mClasses[classFile->nameSymbol()] = classFile;
+    logi("Loaded ", classFile->name(), " from ", origin);
+    // Queued before linking, so that the workers already run while the super classes are linked
+    prefetchReferences(*classFile);
+    link(*classFile);
+}
+
+void ClassLoader::prefetchReferences(const ClassFile& classFile) {
+    if (!mPrefetchWorkers){
+        return;
+    }
+    if (mPrefetchWorkers && !mPrefetcher){
+        mPrefetcher.reset(new ClassPrefetcher(mJars, mArchive, mPrefetchWorkers));
+    }
+
+    // Needed first: super classes and interfaces are loaded by link right away
+    std::vector<std::string> names;
+    if (classFile.superClass()){
+        names.push_back(classFile.superClass().get());
+    }
+    for (const auto& name : classFile.interfaces()){
+        names.push_back(name);
+    }
+    for (const auto& name : classFile.referencedClasses()){
+        names.push_back(name);
+    }
+    for (const auto& name : names){
+        // Not interned: neither loaded nor missing yet
+        const Symbol* symbol = Symbol::find(name);
+        if (!symbol || (mClasses.count(symbol) == 0 && mMissingClasses.count(symbol) == 0)){
+            mPrefetcher->prefetch(name);
+        }
+    }
+}
+
 void ClassLoader::addPath(const std::string& path) {
     if (suffix(path) == "jar"){
-        std::shared_ptr<ZipSource> zipSource = std::make_shared<ZipSource>(path);
-        mJars.push_back(zipSource);
+        mJars.push_back(std::make_shared<JarFile>(path));
+        mMissingClasses.clear();
+        // Its workers search the former jars only, a new one is started on the next load
+        mPrefetcher.reset();
     } else {
         mPaths.push_back(path);
     }
@@ -72,6 +132,48 @@ void ClassLoader::addDefaultPaths() {
     addPath(std::string(javaHome) + "/jre/lib/rt.jar");
 }
 
+std::vector<JarStamp> ClassLoader::jarStamps() const {
+    std::vector<JarStamp> result;
+    for (const auto& jar : mJars){
+        result.push_back(JarStamp::of(jar->path()));
+    }
+    return result;
+}
+
+bool ClassLoader::useArchive(const std::shared_ptr<ClassArchive>& archive) {
+    if (archive->sources() != jarStamps()){
+        logw("Class archive", archive->path(), "was written for other or changed jars, ignoring it");
+        return false;
+    }
+    mArchive = archive;
+    mPrefetcher.reset();
+    return true;
+}
+
+void ClassLoader::writeArchive(const std::string& path) const {
+    ClassArchive::write(path, jarStamps(), mRecordedClasses);
+    logi("Wrote", mRecordedClasses.size(), "classes to", path);
+}
+
+void ClassLoader::link(ClassFile& target) {
+    fillSuperClasses(target);
+    fillInterfaces(target);
+    target.layoutFields();
+    target.layoutMethods();
+    if (target.name() == "java/lang/Class"){
+        // Name of the represented class, see Interpreter::classByName
+        target.addSyntheticField(Symbol::intern("__name"), ObjectRef);
+    }
+}
+
+void ClassLoader::fillInterfaces(ClassFile& target) {
+    std::vector<ClassFilePtr> interfaces;
+    for (const auto& name : target.interfaces()){
+        interfaces.push_back(loadByName(name));
+    }
+    target.setInterfaceFiles(interfaces);
+}
+
 void ClassLoader::fillSuperClasses(ClassFile & target) {
     auto current = target.superClassFile().lock();
     if (!current){
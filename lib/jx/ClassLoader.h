@@ -3,71 +3,65 @@
 #include <memory>
 #include <map>
 #include <unordered_map>
-#include <zip.h>
+#include <unordered_set>
 #include "types.h"
-#include <iostream>
+#include "ClassArchive.h"
+#include "JarFile.h"
+#include "ClassPrefetcher.h"
 
-class ZipSource : public boost::noncopyable{
+class ClassLoader : boost::noncopyable {
 public:
-    ZipSource(const std::string& path){
-        mPath = path;
-
-        int err = 0;
-        mZipHandle = zip_open(path.c_str(), 0, &err);
-        if (err){
-            throw std::invalid_argument("Could not open " + path);
-        }
-        // std::cout << "Opened " << path << std::endl;
-    }
+    std::shared_ptr<ClassFile> loadByFile(const std::string& name);
 
-    ~ZipSource(){
-        zip_close(mZipHandle);
-    }
+    std::shared_ptr<ClassFile> loadByName(const std::string& name);
+    std::shared_ptr<ClassFile> loadByName(const Symbol* name);
 
-    const std::string& path() const { return mPath; }
+    void addPath(const std::string& path);
 
-    ByteArrayPtr findClassSource(const std::string& name) {
-        struct zip_stat stat;
-        zip_stat_init(&stat);
-        zip_stat(mZipHandle, name.c_str(), 0, &stat);
+    void addDefaultPaths();
 
-        if (!stat.valid){
-            return ByteArrayPtr();
-        }
-        ByteArrayPtr ptr = std::make_shared<ByteArray>();
-        ptr->resize (stat.size);
-        zip_file * file = zip_fopen(mZipHandle, name.c_str(), 0);
-        if (!file) {
-            return ByteArrayPtr();
-        }
-        zip_fread(file, &(*ptr->begin()), stat.size);
-        zip_fclose(file);
-        return ptr;
-    }
+    /** Loads classes from the given archive before looking into jars, after the class path was added.
+        Returns false (and does not use it) if the archive was written for other jars. */
+    bool useArchive(const std::shared_ptr<ClassArchive>& archive);
+    const std::shared_ptr<ClassArchive>& archive() const { return mArchive; }
 
+    /** Reads and parses the classes referred to by loaded classes on the given number of background
+        threads (0 disables it), see ClassPrefetcher. The workers start on the next load and are restarted
+        when the class path or the archive changes. */
+    void enablePrefetching(size_t workers) { mPrefetchWorkers = workers; }
+    /** The running prefetcher, if any. */
+    const ClassPrefetcher* prefetcher() const { return mPrefetcher.get(); }
 
+    /** Keeps the class files loaded from jars from now on, for writeArchive. */
+    void recordClasses() { mRecording = true; }
+    /** Writes the recorded class files as ClassArchive. */
+    void writeArchive(const std::string& path) const;
 
 private:
-    std::string mPath;
-    struct zip * mZipHandle;
-
-};
-
-class ClassLoader {
-public:
-    std::shared_ptr<ClassFile> loadByFile(const std::string& name);
+    /** Resolves super classes and lays out the fields. */
+    void link(ClassFile& target);
 
-    std::shared_ptr<ClassFile> loadByName(const std::string& name);
+    std::vector<JarStamp> jarStamps() const;
 
-    void addPath(const std::string& path);
+    /** Registers a freshly parsed class and links it. */
+    void define(const ClassFilePtr& classFile, const std::string& origin);
+    /** Queues the not yet loaded classes the given one refers to at the prefetcher. */
+    void prefetchReferences(const ClassFile& classFile);
 
-    void addDefaultPaths();
-
-private:
     void fillSuperClasses(ClassFile& target);
+    void fillInterfaces(ClassFile& target);
 
     std::vector<std::string> mPaths;
-    std::vector<std::shared_ptr<ZipSource> > mJars;
-    // Sorted by Java Name
-    std::unordered_map<std::string, std::shared_ptr<ClassFile>> mClasses;
+    std::vector<std::shared_ptr<JarFile> > mJars;
+    // By Java Name
+    std::unordered_map<const Symbol*, std::shared_ptr<ClassFile>, hash::SymbolHash> mClasses;
+    /** Classes which are in none of the jars, so that repeated lookups don't search them again. */
+    std::unordered_set<const Symbol*, hash::SymbolHash> mMissingClasses;
+
+    std::shared_ptr<ClassArchive> mArchive;
+    bool mRecording = false;
+    std::map<std::string, ByteArrayPtr> mRecordedClasses;
+
+    size_t mPrefetchWorkers = 0;
+    std::unique_ptr<ClassPrefetcher> mPrefetcher;
 };
\ No newline at end of file
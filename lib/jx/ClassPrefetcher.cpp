@@ -0,0 +1,142 @@
+#include "ClassPrefetcher.h"
+#include "Log.h"
+#include <algorithm>
+
+const size_t ClassPrefetcher::DefaultMaxParsed;
+
+ClassPrefetcher::ClassPrefetcher(const std::vector<std::shared_ptr<JarFile>>& jars, const std::shared_ptr<ClassArchive>& archive, size_t workers,
+                                 size_t maxParsed)
+    : mJars(jars), mArchive(archive), mMaxParsed(maxParsed) {
+    for (size_t i = 0; i < workers; i++){
+        mWorkers.emplace_back(new boost::thread([this] { work(); }));
+    }
+}
+
+ClassPrefetcher::~ClassPrefetcher() {
+    {
+        boost::lock_guard<boost::mutex> lock (mMutex);
+        mStopping = true;
+    }
+    mWorkAvailable.notify_all();
+    for (auto& worker : mWorkers){
+        worker->join();
+    }
+}
+
+size_t ClassPrefetcher::defaultWorkers() {
+    size_t cores = boost::thread::hardware_concurrency();
+    return cores > 1 ? std::min<size_t>(cores - 1, 2) : 0;
+}
+
+void ClassPrefetcher::prefetch(const std::string& name) {
+    {
+        boost::lock_guard<boost::mutex> lock (mMutex);
+        if (!mEntries.emplace(name, Entry()).second){
+            return;
+        }
+        mQueue.push_back(name);
+    }
+    mWorkAvailable.notify_one();
+}
+
+bool ClassPrefetcher::take(const std::string& name, Prefetched& result) {
+    boost::unique_lock<boost::mutex> lock (mMutex);
+    auto i = mEntries.find(name);
+    if (i == mEntries.end()){
+        return false;
+    }
+    Entry& entry = i->second;
+    while (entry.state == InProgress){
+        mLoaded.wait(lock);
+    }
+    if (entry.state != Done){
+        // Still queued, the worker skips it
+        entry.state = Taken;
+        return false;
+    }
+    entry.state = Taken;
+    result = std::move(entry.result);
+    entry.result = Prefetched();
+    mParsed.erase(std::find(mParsed.begin(), mParsed.end(), name));
+    mHits++;
+    return true;
+}
+
+size_t ClassPrefetcher::hits() const {
+    boost::lock_guard<boost::mutex> lock (mMutex);
+    return mHits;
+}
+
+size_t ClassPrefetcher::queued() const {
+    boost::lock_guard<boost::mutex> lock (mMutex);
+    return mEntries.size();
+}
+
+size_t ClassPrefetcher::parsed() const {
+    boost::lock_guard<boost::mutex> lock (mMutex);
+    return mParsed.size();
+}
+
+void ClassPrefetcher::work() {
+    boost::unique_lock<boost::mutex> lock (mMutex);
+    while (true){
+        while (mQueue.empty() && !mStopping){
+            mWorkAvailable.wait(lock);
+        }
+        if (mStopping){
+            return;
+        }
+        std::string name = mQueue.front();
+        mQueue.pop_front();
+        // Entries are never removed, so the reference stays valid while unlocked
+        Entry& entry = mEntries[name];
+        if (entry.state != Queued){
+            continue;
+        }
+        entry.state = InProgress;
+        lock.unlock();
+        Prefetched result;
+        bool loaded = load(name, result);
+        lock.lock();
+        if (loaded){
+            entry.state = Done;
+            entry.result = std::move(result);
+            mParsed.push_back(name);
+            if (mParsed.size() > mMaxParsed){
+                // Most referenced classes are never loaded, don't keep them (and their jar buffers) forever
+                Entry& dropped = mEntries[mParsed.front()];
+                dropped.state = Failed;
+                dropped.result = Prefetched();
+                mParsed.pop_front();
+            }
+        } else {
+            entry.state = Failed;
+        }
+        mLoaded.notify_all();
+    }
+}
+
+bool ClassPrefetcher::load(const std::string& name, Prefetched& result) const {
+    try {
+        const uint8_t* archived = nullptr;
+        size_t archivedSize = 0;
+        if (mArchive && mArchive->find(name, archived, archivedSize)){
+            result.classFile = std::make_shared<ClassFile>(ClassFile::parse(ByteView(archived, archivedSize, mArchive)));
+            result.origin = mArchive->path();
+            return true;
+        }
+        for (const auto& jar : mJars){
+            ByteView bytes = jar->find(name + ".class");
+            if (bytes){
+                result.classFile = std::make_shared<ClassFile>(ClassFile::parse(bytes));
+                result.bytes = bytes;
+                result.origin = jar->path();
+                return true;
+            }
+        }
+    } catch (std::exception& e){
+        // The ClassLoader tries again and reports it, if the class is really needed
+        logd("Could not prefetch", name, e.what());
+    }
+    return false;
+}
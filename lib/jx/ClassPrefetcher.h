@@ -0,0 +1,88 @@
+#pragma once
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include "ClassFile.h"
+#include "ClassArchive.h"
+#include "JarFile.h"
+
+/** Reads and parses class files on a pool of worker threads, ahead of the ClassLoader.
+
+    The ClassLoader queues the classes a freshly loaded class refers to (super class, interfaces,
+    constant pool) and takes the parsed ClassFile once it really needs it. Workers only read and
+    parse; linking (and everything touching loaded classes) stays on the interpreting thread. */
+class ClassPrefetcher : boost::noncopyable {
+public:
+    /** A class file parsed by a worker. */
+    struct Prefetched {
+        ClassFilePtr classFile;
+        /** Raw class file if it came from a jar (for ClassLoader::recordClasses). */
+        ByteView bytes;
+        /** Archive or jar the class was found in. */
+        std::string origin;
+    };
+
+    /** Parsed classes kept for take by default. */
+    static const size_t DefaultMaxParsed = 256;
+
+    /** Looks up classes in the archive (may be null) first, then in the jars in order.
+        At most maxParsed parsed classes are kept, the oldest ones are dropped if they are not taken. */
+    ClassPrefetcher(const std::vector<std::shared_ptr<JarFile>>& jars, const std::shared_ptr<ClassArchive>& archive, size_t workers,
+                    size_t maxParsed = DefaultMaxParsed);
+    ~ClassPrefetcher();
+
+    /** Number of workers used if not given: leaves one core to the interpreter, at most 2. */
+    static size_t defaultWorkers();
+
+    size_t workers() const { return mWorkers.size(); }
+
+    /** Queues a class for loading, names which were queued before are ignored. */
+    void prefetch(const std::string& name);
+
+    /** Hands out a prefetched class, waiting if a worker is busy with it.
+        Returns false if the class was not queued, is still waiting in the queue (it is dropped then,
+        loading it directly is not slower) or could not be loaded; the caller has to load it itself. */
+    bool take(const std::string& name, Prefetched& result);
+
+    /** Classes handed out by take. */
+    size_t hits() const;
+    /** Classes which were queued. */
+    size_t queued() const;
+    /** Parsed classes waiting for take. */
+    size_t parsed() const;
+
+private:
+    enum State { Queued, InProgress, Done, Failed, Taken };
+    struct Entry {
+        State state = Queued;
+        Prefetched result;
+    };
+
+    void work();
+    /** Reads and parses a class, from a worker thread. */
+    bool load(const std::string& name, Prefetched& result) const;
+
+    std::vector<std::shared_ptr<JarFile>> mJars;
+    std::shared_ptr<ClassArchive> mArchive;
+
+    mutable boost::mutex mMutex;
+    /** Signals new work for the workers. */
+    boost::condition_variable mWorkAvailable;
+    /** Signals finished classes for take. */
+    boost::condition_variable mLoaded;
+    std::deque<std::string> mQueue;
+    std::unordered_map<std::string, Entry> mEntries;
+    /** Names of the Done entries, oldest first. */
+    std::deque<std::string> mParsed;
+    size_t mMaxParsed;
+    bool mStopping = false;
+    size_t mHits = 0;
+
+    std::vector<std::unique_ptr<boost::thread>> mWorkers;
+};
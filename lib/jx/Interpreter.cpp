@@ -7,13 +7,13 @@
 #include "MethodOverrides.h"
 #include "StringUtils.h"
 #include "Log.h"
+#include "Profiler.h"
 #include <math.h>
 
 void Frame::ensureLocalArraySpace(int idx){
     assert (idx >= 0);
     if (idx >= localArray.size()){
-        logw("Increasing local array size to meet idx ", idx);
-        localArray.variables.resize(idx + 1);
+        throw std::invalid_argument("Local variable index " + util::toString(idx) + " exceeds max locals " + util::toString(localArray.size()));
     }
 }
 
@@ -22,6 +22,64 @@ Interpreter::Interpreter(){
     mMethodOverrides = std::shared_ptr<MethodOverrides>(new MethodOverrides());
     mMethodOverrides->addDefaultOverrides();
     mInstructionCount = 0;
+#ifdef JX_THREADED_DISPATCH
+    mDispatchMode = ThreadedDispatch;
+#else
+    mDispatchMode = SwitchDispatch;
+#endif
+}
+
+void Interpreter::setDispatchMode(DispatchMode mode) {
+#ifndef JX_THREADED_DISPATCH
+    if (mode == ThreadedDispatch){
+        throw std::invalid_argument("Threaded dispatch not compiled in, see JX_THREADED_DISPATCH");
+    }
+#endif
+    mDispatchMode = mode;
+}
+
+std::vector<CallSiteStats> Interpreter::callSiteStats() const {
+    std::vector<CallSiteStats> result;
+    for (const PreparedMethod* prepared : mTranslatedMethods){
+        for (const InlineCache& cache : prepared->threadedCode->inlineCaches){
+            if (!cache.reference){
+                // Never executed
+                continue;
+            }
+            CallSiteStats stats;
+            stats.className = prepared->clazz->name();
+            stats.methodName = prepared->methodName->str();
+            stats.pc = cache.pc;
+            stats.callee = cache.reference->methodIdentifier.toString();
+            if (cache.megamorphic){
+                stats.state = Megamorphic;
+            } else {
+                stats.state = cache.size > 1 ? Polymorphic : Monomorphic;
+            }
+            stats.receiverCount = cache.size;
+            stats.hits = cache.hits;
+            stats.misses = cache.misses;
+            result.push_back(stats);
+        }
+    }
+    return result;
+}
+
+void Interpreter::collectGarbage() {
+    mMemory.collect([this](VmMemory& memory) {
+        for (const Frame* frame = mTopFrame; frame; frame = frame->caller){
+            for (size_t i = 0; i < frame->localArray.count; i++){
+                memory.mark(frame->localArray.variables[i]);
+            }
+            for (const Variable* v = frame->stack.base; v != frame->stack.sp; v++){
+                memory.mark(*v);
+            }
+        }
+        for (const auto& interned : mInternedStrings){
+            memory.mark(interned.second);
+        }
+        memory.mark(mMainThread);
+    });
 }
 
 void Interpreter::executeFile(const std::string &filename) {
@@ -75,70 +133,152 @@ void Interpreter::executeMain(const ClassFile &clazz) {
 
 Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& method, const Frame &previousFrame,
                                 const Variables &arguments) {
+    Variable* begin = mStack.top();
+    VmStack::Reservation reservation (mStack, begin, arguments.size());
+    std::copy(arguments.variables.begin(), arguments.variables.end(), begin);
+    return executeMethod(clazz, method, previousFrame, begin, arguments.size());
+}
 
-    std::string className = clazz.name();
-    std::string methodName = clazz.methodName(method);
-    std::string descriptor = clazz.descriptorForMethod(method);
-    MethodOverrideIdentifier identifier;
-    identifier.className = className;
-    identifier.methodName = methodName;
-    identifier.description = descriptor;
+Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& method, const Frame &previousFrame,
+                                Variable* arguments, size_t argumentCount) {
+    return executePrepared(prepareMethod(clazz, method), previousFrame, arguments, argumentCount);
+}
 
-    auto ov = mMethodOverrides->find(identifier);
-    if (ov){
-        logi("Using override for", identifier.className, identifier.methodName, identifier.description);
+class Interpreter::FrameScope : public boost::noncopyable {
+public:
+    FrameScope(Interpreter& interpreter, Frame& frame) : mInterpreter(interpreter), mFrame(frame) {
+        frame.caller = interpreter.mTopFrame;
+        interpreter.mTopFrame = &frame;
+    }
+    ~FrameScope() {
+        mInterpreter.mTopFrame = mFrame.caller;
+    }
+private:
+    Interpreter& mInterpreter;
+    Frame& mFrame;
+};
+
+namespace {
+
+/** Reports entering and leaving a method to the profiler, if there is one. */
+class ProfileScope {
+public:
+    ProfileScope(Profiler* profiler, const PreparedMethod& prepared) : mProfiler(profiler) {
+        if (mProfiler){
+            mProfiler->enterMethod(prepared);
+        }
+    }
+    ~ProfileScope() {
+        if (mProfiler){
+            mProfiler->leaveMethod();
+        }
+    }
+private:
+    Profiler* mProfiler;
+};
+
+}
+
+Variable Interpreter::executePrepared(const PreparedMethod& prepared, const Frame& previousFrame, Variable* arguments, size_t argumentCount) {
+    const ClassFile& clazz = *prepared.clazz;
+    ProfileScope profileScope (mProfiler, prepared);
+
+    if (prepared.override){
+        logt("Using override for", clazz.name(), *prepared.methodName, *prepared.descriptorSymbol);
+        // Keeps the arguments reachable while the override runs
+        Frame overrideFrame;
+        overrideFrame.method = &prepared;
+        overrideFrame.localArray.variables = arguments;
+        overrideFrame.localArray.count = argumentCount;
+        FrameScope scope (*this, overrideFrame);
+        pollStackSampler();
         FunctionContext context { this, &mClassLoader, &mMemory, &previousFrame };
-        return ov(context, arguments);
+        return prepared.override->call(context, overrideFrame.localArray);
     }
 
-    if (method.isNative()){
-        logw("Method", className, methodName, descriptor, "is native, skipping");
-        DescriptorParser parsedDescriptor (descriptor);
-        return Variable(parsedDescriptor.type());
+    if (prepared.isNative){
+        logw("Method", clazz.name(), *prepared.methodName, *prepared.descriptorSymbol, "is native, skipping");
+        return Variable(prepared.descriptor.type());
     }
 
+    if (!prepared.hasCode){
+        throw std::invalid_argument("Method " + clazz.name() + " " + prepared.methodName->str() + " has no code block, abstract?");
+    }
 
     Frame frame;
+    frame.method = &prepared;
 
-    auto code = clazz.codeForMethod(method);
-    const ByteRange& bytes = code.code;
+    const CodeIdentifier& code = prepared.code;
 
-    auto pc = bytes.begin;
-    for (const Variable & v : arguments.variables){
-        frame.localArray.push(v);
-    }
+    // Locals start with the arguments, followed by the operand stack
+    size_t localCount = std::max<size_t>(code.maxLocals, argumentCount);
+    VmStack::Reservation reservation (mStack, arguments, localCount + code.maxStack);
+    frame.localArray.variables = arguments;
+    frame.localArray.count = localCount;
+    std::fill(arguments + argumentCount, arguments + localCount, Variable());
+    frame.stack.base = arguments + localCount;
+    frame.stack.sp = frame.stack.base;
 
-    frame.localArray.variables.resize(code.maxLocals);
-    if (!(method.accessFlags & Flags::STATIC)){
+    if (!prepared.isStatic){
         assert(!frame.localArray.empty());
-        Variable& firstThisArgument = *frame.localArray.variables.begin();
+        Variable& firstThisArgument = frame.localArray.variables[0];
         assert(firstThisArgument.type == ObjectRef);
         assert(firstThisArgument.value.object != nullptr);
         frame.thisp = firstThisArgument.value.object;
     }
+    FrameScope scope (*this, frame);
+    pollStackSampler();
 
-    logd("Interpreting", className, methodName, "arg count", arguments.size());
+    logt("Interpreting", clazz.name(), *prepared.methodName, "arg count", argumentCount);
     // std::cout << "  Arguments: ";
-    // for (const auto& arg : arguments.variables){
-    //    std::cout << arg.toString() << " ";
+    // for (size_t i = 0; i < argumentCount; i++){
+    //    std::cout << arguments[i].toString() << " ";
     // }
     // std::cout << std::endl;
 
-    auto lastPc = pc;
-    while (pc < bytes.end){
-        mInstructionCount++;
+#ifdef JX_THREADED_DISPATCH
+    if (mDispatchMode == ThreadedDispatch && !mProfiler){
+        return executeThreaded(frame, clazz, prepared);
+    }
+#endif
+    return executeSwitch(frame, clazz, prepared);
+}
+
+Variable Interpreter::executeSwitch(Frame& frame, const ClassFile& clazz, const PreparedMethod& prepared) {
+    const ByteRange& bytes = prepared.code.code;
+    auto pc = bytes.begin;
+    Variable returnValue;
+    if (runSwitch(frame, clazz, bytes, pc, returnValue, false)){
+        return returnValue;
+    }
+    logt("Leaving... ");
+    return Variable();
+}
+
+bool Interpreter::executeInstruction(Frame& frame, const ClassFile& clazz, const ByteRange& bytes, ByteRange::Iterator& pc, Variable& returnValue) {
+    return runSwitch(frame, clazz, bytes, pc, returnValue, true);
+}
+
+bool Interpreter::runSwitch(Frame& frame, const ClassFile& clazz, const ByteRange& bytes, ByteRange::Iterator& pc, Variable& returnValue, bool singleStep) {
+    // Jumps continue, so that the loop condition also ends a single step
+    for (bool first = true; pc < bytes.end && (first || !singleStep); first = false){
+        if (!singleStep){
+            mInstructionCount++;
+            if (mProfiler){
+                mProfiler->instruction(*pc);
+            }
+            pollStackSampler();
+        }
         auto op = *pc;
-        auto deltaPc = pc - lastPc;
-        // std::cout << "Interpreting: " << className << "::" << methodName << " " << util::toHex((int)op) << " " << ops::opToStr(op) <<  " (dpc=" << deltaPc << ")"  << " instr=" << mInstructionCount << std::endl;
+        // std::cout << "Interpreting: " << clazz.name() << " " << util::toHex((int)op) << " " << ops::opToStr(op) << " instr=" << mInstructionCount << std::endl;
         // std::cout << "  Stack: ";
-        // for (auto v : frame.stack.variables){
-        //    std::cout << v.toString()/*variableTypeToString(v.type)*/ << " ";
+        // for (auto v = frame.stack.base; v != frame.stack.sp; v++){
+        //    std::cout << v->toString()/*variableTypeToString(v.type)*/ << " ";
         // }
         // std::cout << std::endl << std::endl;
-        lastPc = pc;
 
         switch (op){
-            case ops::nop: pc++; break;
+            case ops::nop: break;
             case ops::dup:
                 frame.stack.push(frame.stack.top());
                 break;
@@ -246,7 +386,7 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
             }
             case ops::ldc: {
                 uint8_t index = bytes.fetchUint8(pc + 1);
-                logd("Loading constant ", index);
+                logt("Loading constant ", index);
                 auto constant = clazz.constantEntry(index);
                 Variable v;
                 switch(constant.tag){
@@ -258,13 +398,11 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
                         v.type = Integer;
                         v.value.fv = constant.floatValue();
                         break;
-                    case ConstantEntry::StringTag: {
-                        std::string utf8 = clazz.getUtf8Constant(constant.nameIndex());
-                        v = initializeString(utf8, frame);
+                    case ConstantEntry::StringTag:
+                        v = Variable(resolveString(clazz, index, frame).string);
                         break;
-                    }
                     case ConstantEntry::ClassTag: {
-                        std::string name = clazz.getUtf8Constant(constant.nameIndex());
+                        const std::string& name = clazz.getUtf8Constant(constant.nameIndex());
                         v = classByName(name);
                         break;
                     }
@@ -277,7 +415,7 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
             }
             case ops::ldc_w: {
                 uint16_t index = bytes.fetchUint16(pc + 1);
-                logd ("Loading constant ", index);
+                logt ("Loading constant ", index);
                 auto constant = clazz.constantEntry(index);
                 Variable v;
                 switch(constant.tag){
@@ -289,13 +427,11 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
                         v.type = Integer;
                         v.value.fv = constant.floatValue();
                         break;
-                    case ConstantEntry::StringTag: {
-                        std::string utf8 = clazz.getUtf8Constant(constant.nameIndex());
-                        v = initializeString(utf8, frame);
+                    case ConstantEntry::StringTag:
+                        v = Variable(resolveString(clazz, index, frame).string);
                         break;
-                    }
                     case ConstantEntry::ClassTag: {
-                        std::string name = clazz.getUtf8Constant(constant.nameIndex());
+                        const std::string& name = clazz.getUtf8Constant(constant.nameIndex());
                         v = classByName(name);
                         break;
                     }
@@ -308,7 +444,7 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
             }
             case ops::ldc2_w: {
                 uint16_t index = bytes.fetchUint16(pc + 1);
-                logd("Loading constant ", index);
+                logt("Loading constant ", index);
                 auto constant = clazz.constantEntry(index);
                 Variable v;
                 switch(constant.tag){
@@ -334,46 +470,60 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
                 v.value.iv = value;
                 frame.stack.push(v);
                 pc++;
-                logd("bipush ", v.value.iv);
+                logt("bipush ", v.value.iv);
                 break;
             }
-            case ops::bastore: {
-                Variable value = frame.stack.pop();
-                Variable index = frame.stack.pop();
-                Variable arrayRef = frame.stack.pop();
-                assert (value.isStoredAsInteger());
-                assert (index.isStoredAsInteger());
-                assert (arrayRef.isArray());
-                int8_t valueToStore = (int8_t) value.value.iv;
-                assert (index.value.iv >= 0 && index.value.iv < arrayRef.array()->length);
-                arrayRef.array()->values[index.value.iv].iv = valueToStore;
+            // Array elements are stored in their own width, bytes and booleans share baload/bastore
+            case ops::iaload:
+                arrayLoad<int32_t>(frame.stack, Integer);
                 break;
-            }
-            case ops::iastore: {
-                Variable value = frame.stack.pop();
-                Variable index = frame.stack.pop();
-                Variable arrayRef = frame.stack.pop();
-                assert (value.isStoredAsInteger());
-                assert (index.isStoredAsInteger());
-                assert (arrayRef.isArray());
-                int32_t valueToStore = value.value.iv;
-                assert (index.value.iv >= 0 && index.value.iv < arrayRef.array()->length);
-                arrayRef.array()->values[index.value.iv].iv = valueToStore;
+            case ops::laload:
+                arrayLoad<int64_t>(frame.stack, Long);
                 break;
-            }
-            case ops::baload: {
-                Variable index = frame.stack.pop();
-                Variable arrayRef = frame.stack.pop();
-                assert (index.isStoredAsInteger());
-                assert (arrayRef.isArray());
-                assert (index.value.iv >= 0 && index.value.iv < arrayRef.array()->length);
-                int8_t valueToLoad = (int8_t) arrayRef.array()->values[index.value.iv].iv;
-                Variable result (Byte);
-                result.value.iv = valueToLoad;
-                frame.stack.push(result);
+            case ops::faload:
+                arrayLoad<float>(frame.stack, Float);
+                break;
+            case ops::daload:
+                arrayLoad<double>(frame.stack, Double);
+                break;
+            case ops::aaload:
+                arrayLoad<Object*>(frame.stack, ObjectRef);
+                break;
+            case ops::baload:
+                arrayLoad<int8_t>(frame.stack, Byte);
+                break;
+            case ops::caload:
+                arrayLoad<uint16_t>(frame.stack, Char);
+                break;
+            case ops::saload:
+                arrayLoad<int16_t>(frame.stack, Short);
+                break;
+            case ops::iastore:
+                arrayStore<int32_t>(frame.stack);
+                break;
+            case ops::lastore:
+                arrayStore<int64_t>(frame.stack);
+                break;
+            case ops::fastore:
+                arrayStore<float>(frame.stack);
+                break;
+            case ops::dastore:
+                arrayStore<double>(frame.stack);
+                break;
+            case ops::aastore:
+                arrayStore<Object*>(frame.stack);
+                break;
+            case ops::bastore:
+                arrayStore<int8_t>(frame.stack);
+                break;
+            case ops::castore:
+                arrayStore<uint16_t>(frame.stack);
+                break;
+            case ops::sastore:
+                arrayStore<int16_t>(frame.stack);
                 break;
-            }
             case ops::newarray: {
+                safepoint();
                 assert(frame.stack.top().isStoredAsInteger());
                 assert(frame.stack.top().value.iv >= 0);
                 uint32_t length = (uint32_t) frame.stack.pop().value.iv;
@@ -381,15 +531,16 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
                 VariableType type = Array::fromArrayTypeCode(valueTypeCode);
                 Variable array = mMemory.allocateArray(type, length);
                 frame.stack.push(array);
-                logd("Initialized array of length ", length, " of type ", variableTypeToString(type));
+                logt("Initialized array of length ", length, " of type ", variableTypeToString(type));
                 pc++;
                 break;
             }
             case ops::anewarray: {
+                safepoint();
                 uint16_t typeIdx = bytes.fetchUint16(pc + 1);
                 const ConstantEntry & entry = clazz.constantEntry(typeIdx);
                 assert(entry.tag == ConstantEntry::ClassTag);
-                std::string className = clazz.getUtf8Constant(entry.nameIndex());
+                const std::string& className = clazz.getUtf8Constant(entry.nameIndex());
 
                 Variable len = frame.stack.pop();
                 assert(len.isStoredAsInteger());
@@ -400,7 +551,7 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
 
                 Variable array = mMemory.allocateObjectArray(length, className);
                 frame.stack.push(array);
-                logd("Initialized array of length ", length, " of type ", variableTypeToString(type), "(descriptor=", className, ")");
+                logt("Initialized array of length ", length, " of type ", variableTypeToString(type), "descriptor", className);
                 pc+=2;
                 break;
             }
@@ -413,68 +564,13 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
                 frame.stack.push(v);
                 break;
             }
-            case ops::castore: {
-                assert(frame.stack.size() >= 3);
-
-                assert(frame.stack.top().isStoredAsInteger());
-                int32_t v = frame.stack.pop().value.iv;
-                uint16_t converted = (uint16_t) (v);
-
-                Variable indexRef = frame.stack.pop();
-                Variable arrayRef = frame.stack.pop();
-
-                assert(indexRef.type == Integer);
-                assert(arrayRef.isArray());
-
-                arrayRef.array()->values[indexRef.value.iv].iv = converted;
-                break;
-            }
-            case ops::aastore: {
-                assert(frame.stack.size() >= 3);
-
-                Variable v = frame.stack.pop();
-                Variable indexRef = frame.stack.pop();
-                Variable arrayRef = frame.stack.pop();
-                assert(indexRef.isStoredAsInteger());
-                assert(arrayRef.isArray());
-                assert(indexRef.value.iv >= 0 && indexRef.value.iv < arrayRef.array()->length);
-
-                assert(v.memoryType() == arrayRef.array()->memoryType());
-
-
-
-                arrayRef.array()->values[indexRef.value.iv].object = v.value.object;
-                break;
-            }
-            case ops::caload: {
-                Variable idx = frame.stack.pop();
-                Variable array = frame.stack.pop();
-                assert (idx.type == Integer);
-                assert (array.isArray());
-                Variable result (Char);
-                result.value.iv = array.array()->values[idx.value.iv].iv;
-                frame.stack.push(result);
-                break;
-            }
-            case ops::aaload: {
-                Variable idx = frame.stack.pop();
-                Variable array = frame.stack.pop();
-                assert (idx.type == Integer);
-                assert(array.isArray());
-
-                assert (idx.value.iv >= 0 && idx.value.iv < array.array()->length);
-
-                Variable result (array.array()->type);
-                result.value.object = array.array()->values[idx.value.iv].object;
-                frame.stack.push(result);
-                break;
-            }
             case ops::new_: {
+                safepoint();
                 auto classIndex = bytes.fetchUint16(pc + 1);
                 pc+=2;
-                auto className = clazz.findClass(classIndex);
+                const Symbol* className = clazz.classSymbol(classIndex);
 
-                logi("Allocating class ", className);
+                logt("Allocating class ", *className);
 
                 auto classFile = findInitializedClass(className);
 
@@ -485,10 +581,10 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
             case ops::checkcast: {
                 auto classIndex = bytes.fetchUint16(pc + 1);
                 pc+=2;
-                auto className  = clazz.findClass(classIndex);
+                const Symbol* className = clazz.classSymbol(classIndex);
                 Variable var = frame.stack.top();
-                if (!className.empty()){
-                    if (className[0] == '['){
+                if (!className->str().empty()){
+                    if (className->str()[0] == '['){
                         if (var.isArray()){
                             // ok
                             break;
@@ -503,7 +599,7 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
 
                 assert(var.type == ObjectRef);
                 if (var.value.object != nullptr){
-                    logi("[FixMe] Check cast, slow and wrong");
+                    logt("[FixMe] Check cast, slow and wrong");
                     ClassFilePtr current = var.value.object->type;
                     bool proved = false;
                     while (current){
@@ -515,14 +611,14 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
                         current = current->superClassFile().lock();
                     }
                     if (!proved){
-                        logi("FIXME, Could not prove that ", var.value.object->type->name(), " is a sub type of ", className," nothing, works, exceptions are also not supported :/");
+                        logt("FIXME, Could not prove that ", var.value.object->type->name(), " is a sub type of ", *className," nothing, works, exceptions are also not supported :/");
                     }
                 }
                 break;
             }
             case ops::instanceof: {
                 auto classIndex = bytes.fetchUint16(pc + 1);
-                auto className  = clazz.findClass(classIndex);
+                const Symbol* className = clazz.classSymbol(classIndex);
                 auto otherClassFile = findInitializedClass(className);
 
                 pc+=2;
@@ -531,13 +627,12 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
                 if (var.value.object == nullptr){
                     frame.stack.push(Variable(int32_t(0))); // false
                 } else {
-                    logi("[FixMe] instanceof, slow and wrong");
+                    logt("[FixMe] instanceof, slow and wrong");
                     ClassFilePtr current = var.value.object->type;
                     bool proved = false;
                     while (current && !proved) {
-                        auto interfaces = current->interfaces();
-                        for (auto interfaceName : interfaces){
-                            if (interfaceName == className){
+                        for (const auto& interface : current->interfaceFiles()){
+                            if (interface == otherClassFile){
                                 proved = true;
                                 break;
                             }
@@ -554,85 +649,48 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
                     if (proved){
                         frame.stack.push(Variable(int32_t(1)));
                     } else {
-                        logi("FIXME, Could not prove that ", var.value.object->type->name(),
-                        " is a sub type of ", className," nothing, works, exceptions are also not supported :/");
+                        logt("FIXME, Could not prove that ", var.value.object->type->name(),
+                        " is a sub type of ", *className," nothing, works, exceptions are also not supported :/");
                         frame.stack.push(Variable(int32_t(0)));
                     }
-                    logd("Result of instance of ", var.value.object->type->name(), " is ",  className, " -> ",proved);
+                    logt("Result of instance of ", var.value.object->type->name(), " is ",  *className, " -> ",proved);
                 }
                 break;
             }
             case ops::invokespecial:{
                 auto index = bytes.fetchUint16(pc + 1);
-                const auto& method = clazz.findMethod(index);
-
-                logd("Invoke special on index ", index, method.toString());
-                const auto& methodClazz = findInitializedClass(method.className);
-                MethodInfo methodInfo = methodClazz->methodWithSignature(method).get();
-
-                DescriptorParser descriptorParser(method.descriptor);
-                auto argCount = descriptorParser.argumentCount();
+                const ResolvedReference& method = resolveMethod(clazz, index);
 
-
-                Variable result;
-                if (methodInfo.accessFlags & Flags::STATIC){
-                    Variables args;
-                    args.variables = frame.stack.popAndReturnMany(argCount);
-                    // omit this pointer?
-                    result = executeMethod(clazz, methodInfo, frame, args);
-                } else {
-                    Variables args;
-                    // including this pointer
-                    args.variables = frame.stack.popAndReturnMany(argCount + 1);
-
-                    result = executeMethod(*methodClazz, methodInfo, frame, args);
-                }
-                handleReturn(&frame, result, descriptorParser);
+                logt("Invoke special on index ", index, method.methodIdentifier.toString());
+                invokeDirect(frame, method);
                 pc+=2;
                 break;
             }
             case ops::invokevirtual:{
                 auto index = bytes.fetchUint16(pc + 1);
+                uint32_t callPc = pc - bytes.begin;
                 pc+=2;
-                const auto method = clazz.findMethod(index);
-
-                auto desc = DescriptorParser(method.descriptor);
-                Variable thisPointer = *(frame.stack.variables.rbegin() + desc.argumentCount());
-
-                logd("Looking for ", method.methodName, "of", method.className);
-                auto methodInfo = virtualMethodDispatch(method, thisPointer);
-                logd("Found virtual method ", method.methodName, "of", clazz.name(), "in", methodInfo.first->name());
-
-                // arguments are in same order like on stack, adding argCount and this pointer (which is alredy placed)
-                Variables args;
-                args.variables = frame.stack.popAndReturnMany(desc.argumentCount() + 1);
+                const ResolvedReference& method = resolveVirtualMethod(clazz, index, false);
+                if (mProfiler){
+                    mProfiler->receiver(callPc, frame.stack.top(method.descriptor.argumentCount()));
+                }
 
-                logd("Invoking ", method.toString(), "Arg count", desc.argumentCount());
-                Variable result = executeMethod(*methodInfo.first, methodInfo.second, frame, args);
-                handleReturn(&frame, result, desc);
+                invokeVirtual(frame, method);
                 break;
             }
             case ops::invokeinterface: {
                 uint16_t index = bytes.fetchUint16(pc + 1);
                 uint8_t count = bytes.fetchInt8(pc + 3);
+                uint32_t callPc = pc - bytes.begin;
 
                 pc+=4;
 
-                const auto method = clazz.findInterfaceMethod(index);
-
-                auto desc = DescriptorParser(method.descriptor);
-                Variable thisPointer = *(frame.stack.variables.rbegin() + desc.argumentCount());
-
-                auto methodInfo = virtualMethodDispatch(method, thisPointer);
-                logd("Found virtual method ", method.methodName, "of", clazz.name(), "in", methodInfo.first->name());
-
-                // arguments are in same order like on stack, adding argCount and this pointer (which is alredy placed)
-                Variables args;
-                args.variables = frame.stack.popAndReturnMany(desc.argumentCount() + 1);
+                const ResolvedReference& method = resolveVirtualMethod(clazz, index, true);
+                if (mProfiler){
+                    mProfiler->receiver(callPc, frame.stack.top(method.descriptor.argumentCount()));
+                }
 
-                logd("Invoking ", method.toString(), " Arg count ", desc.argumentCount());
-                Variable result = executeMethod(*methodInfo.first, methodInfo.second, frame, args);
-                handleReturn(&frame, result, desc);
+                invokeVirtual(frame, method);
                 break;
             }
             // aload (object references)
@@ -761,36 +819,42 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
                 break;
             }
             case ops::return_:
-                return Variable();
+                returnValue = Variable();
+                return true;
             case ops::ireturn: {
                 assert(!frame.stack.empty());
                 auto ir = frame.stack.pop();
                 assert(ir.isStoredAsInteger());
-                return ir;
+                returnValue = ir;
+                return true;
             }
             case ops::dreturn: {
                 assert(!frame.stack.empty());
                 auto dr = frame.stack.pop();
                 assert(dr.type == Double);
-                return dr;
+                returnValue = dr;
+                return true;
             }
             case ops::freturn: {
                 assert(!frame.stack.empty());
                 auto fr = frame.stack.pop();
                 assert(fr.type == Float);
-                return fr;
+                returnValue = fr;
+                return true;
             }
             case ops::lreturn: {
                 assert(!frame.stack.empty());
                 auto lr = frame.stack.pop();
                 assert(lr.type == Long);
-                return lr;
+                returnValue = lr;
+                return true;
             }
             case ops::areturn: {
                 assert(!frame.stack.empty());
                 auto objectReturn = frame.stack.pop();
                 assert(objectReturn.type == ObjectRef || objectReturn.type == ArrayRef);
-                return objectReturn;
+                returnValue = objectReturn;
+                return true;
             }
             case ops::iadd: {
                 auto v2 = frame.stack.pop();
@@ -1110,96 +1174,59 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
             }
             case ops::getstatic: {
                 auto index = bytes.fetchUint16(pc + 1);
-                auto info = clazz.findFieldRefIdentifier(index);
+                const ResolvedReference& field = resolveStaticField(clazz, index);
                 pc+=2;
 
-                logd("Get static, index ", index, " info ", info.toString());
-                findInitializedClass(info.className);
-
-                Variable v = mMemory.getGlobal(info.className, info.fieldName);
-                frame.stack.push(v);
+                logt("Get static, index ", index);
+                frame.stack.push(*field.staticField);
                 break;
             }
             case ops::putstatic: {
                 auto index = bytes.fetchUint16(pc + 1);
-                auto info = clazz.findFieldRefIdentifier(index);
+                const ResolvedReference& field = resolveStaticField(clazz, index);
                 pc+=2;
 
-                logd("Put static, index " index, " info ", info.toString());
-                auto otherClazz = findInitializedClass(info.className);
-
-                mMemory.putGlobal(info.className, info.fieldName, frame.stack.pop());
+                logt("Put static, index ", index);
+                VmMemory::storeGlobal(field.staticField, frame.stack.pop());
                 break;
             }
             case ops::putfield: {
                 uint16_t fieldId = bytes.fetchUint16(pc + 1);
-                FieldRefIdentifier fieldRefIdentifier = clazz.findFieldRefIdentifier(fieldId);
-                std::string fieldName = /*fieldRefIdentifier.className + "__" +*/ fieldRefIdentifier.fieldName;
+                const ResolvedReference& fieldReference = resolveField(clazz, fieldId);
 
                 Variable v = frame.stack.pop();
                 Variable objectRef = frame.stack.pop();
                 assert(objectRef.type == ObjectRef);
 
-                // std::string fieldName = clazz.getFieldName(fieldId);
-                logd("Put field ", fieldId, " current class ", clazz.name(), " name: ", fieldName);
+                logt("Put field ", fieldId, " current class ", clazz.name(), " name: ", *fieldReference.fieldKey);
 
                 assert(objectRef.value.object != nullptr);
-                Variable * field = objectRef.value.object->publicField(fieldRefIdentifier.fieldName);
-                if (field == nullptr){
-                    // TODO: Check!!
-                    field = objectRef.value.object->privateField(fieldRefIdentifier.className, fieldRefIdentifier.fieldName);
-                }
-                if (field == nullptr){
-                    throw std::invalid_argument("Field " + fieldName + " not found in instance of " + frame.thisp->type->name());
-                }
-                *field = v;
+                assert(fieldReference.fieldSlot < objectRef.value.object->fields.size());
+                objectRef.value.object->fields[fieldReference.fieldSlot] = v;
                 pc+=2;
                 break;
             }
             case ops::getfield: {
                 uint16_t fieldId = bytes.fetchUint16(pc + 1);
+                const ResolvedReference& fieldReference = resolveField(clazz, fieldId);
 
                 Variable objectRef = frame.stack.pop();
                 assert(objectRef.type == ObjectRef);
 
-                FieldRefIdentifier fieldRefIdentifier = clazz.findFieldRefIdentifier(fieldId);
-                std::string fieldName = /*fieldRefIdentifier.className + "__" +*/ fieldRefIdentifier.fieldName;
-
-                Variable * field = objectRef.value.object->publicField(fieldRefIdentifier.fieldName);
-                if (field == nullptr){
-                    // TODO: Check!!
-                    field = objectRef.value.object->privateField(fieldRefIdentifier.className, fieldRefIdentifier.fieldName);
-                }
-                if (field == nullptr){
-                    logi ("Valid Fields ", objectRef.value.object->fields.size());
-                    logi ("Object type ", objectRef.value.object->type->name());
-                    for (auto field : objectRef.value.object->fields){
-                        logi("Field ", field.first);
-                    }
-                    throw std::invalid_argument("Could not find field " + fieldName);
-                }
-                frame.stack.push(*field);
-                logd("Loaded field ", fieldName,  "type", variableTypeToString(field->type));
+                assert(objectRef.value.object != nullptr);
+                assert(fieldReference.fieldSlot < objectRef.value.object->fields.size());
+                const Variable& field = objectRef.value.object->fields[fieldReference.fieldSlot];
+                frame.stack.push(field);
+                logt("Loaded field ", *fieldReference.fieldKey,  "type", variableTypeToString(field.type));
                 pc+=2;
                 break;
             }
             case ops::invokestatic: {
                 auto index = bytes.fetchUint16(pc + 1);
-                auto info = clazz.findMethod(index);
-                logd("InvokeStatic, index ", index, "info", info.toString());
-                auto clazz = findInitializedClass(info.className);
-                auto methodInfo = clazz->methodWithSignature(info).get();
-
-                DescriptorParser descriptorParser(info.descriptor);
-
-                auto argCount = descriptorParser.argumentCount();
-                // arguments are in same order like on stack, adding argCount
-                Variables args;
-                args.variables = frame.stack.popAndReturnMany(argCount);
-
-                Variable result = executeMethod(*clazz, methodInfo, frame, args);
-                handleReturn(&frame, result, descriptorParser);
+                const ResolvedReference& method = resolveMethod(clazz, index);
+                logt("InvokeStatic, index ", index, "info", method.methodIdentifier.toString());
 
+                invokeDirect(frame, method);
                 pc+=2;
                 break;
             }
@@ -1210,11 +1237,11 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
                 assert(top.isStoredAsInteger());
                 bool isGe = op == ops::ifge;
                 if ((top.value.iv >= 0) == isGe){
-                    logd("ifge/lt Jumping! ", isGe, top.value.iv);
+                    logt("ifge/lt Jumping! ", isGe, top.value.iv);
                     pc = pc + target;
                     continue;
                 } else {
-                    logd("No jump");
+                    logt("No jump");
                 }
                 pc+=2;
                 break;
@@ -1237,11 +1264,11 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
                 assert(v1.isStoredAsInteger());
                 bool isGt = op == ops::if_icmpge;
                 if ((v1.value.iv >= v2.value.iv) == isGt){
-                    logd("if_cmpge/if_icmplt Jumping!");
+                    logt("if_cmpge/if_icmplt Jumping!");
                     pc = pc + target;
                     continue;
                 } else {
-                    logd("No jump ");
+                    logt("No jump ");
                 }
                 pc+=2;
                 break;
@@ -1257,11 +1284,11 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
                 assert(v2.isStoredAsInteger());
                 assert(v1.isStoredAsInteger());
                 if ((v1.value.iv == v2.value.iv) == isEq){
-                    logd("if_icmpne/if_icmpeq Jumping! ");
+                    logt("if_icmpne/if_icmpeq Jumping! ");
                     pc = pc + target;
                     continue;
                 } else {
-                    logd("No jump ");
+                    logt("No jump ");
                 }
                 pc+=2;
                 break;
@@ -1273,11 +1300,11 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
                 assert(top.isStoredAsInteger());
                 bool isGt = op == ops::ifgt;
                 if (top.value.iv > 0 == isGt){
-                    logd("ifle/ifgt Jumping! ");
+                    logt("ifle/ifgt Jumping! ");
                     pc = pc + target;
                     continue;
                 } else {
-                    logd("No jump ", top.value.iv, " isGt ",isGt);
+                    logt("No jump ", top.value.iv, " isGt ",isGt);
                 }
                 pc+=2;
                 break;
@@ -1289,11 +1316,11 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
                 assert(top.type == ObjectRef || top.type == ArrayRef);
                 bool isIfNull = op == ops::ifnull;
                 if ((top.value.object == nullptr) == isIfNull){
-                    logd("ifnull Jumping! isIfNull", isIfNull, top.value.object);
+                    logt("ifnull Jumping! isIfNull", isIfNull, top.value.object);
                     pc = pc + target;
                     continue;
                 } else {
-                    logd("No jump");
+                    logt("No jump");
                 }
                 pc+=2;
                 break;
@@ -1307,11 +1334,11 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
                 assert (v2.type == ObjectRef);
                 assert (v1.type == ObjectRef);
                 if ((v1.value.object == v2.value.object) == isEq){
-                    logd("if_acmpne Jumping! isEq", isEq);
+                    logt("if_acmpne Jumping! isEq", isEq);
                     pc = pc + target;
                     continue;
                 } else {
-                    logd("No jump");
+                    logt("No jump");
                 }
                 pc+=2;
                 break;
@@ -1323,11 +1350,11 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
                 assert(top.type == Integer || top.type == Boolean);
                 bool isEq = op == ops::ifeq;
                 if ((top.value.iv == 0) == isEq){
-                    logd("ifne/ifeq Jumping! ", top.value.iv);
+                    logt("ifne/ifeq Jumping! ", top.value.iv);
                     pc = pc + target;
                     continue;
                 } else {
-                    logd("No jump ", top.value.iv,  "isEq=", isEq);
+                    logt("No jump ", top.value.iv,  "isEq=", isEq);
                 }
                 pc+=2;
                 break;
@@ -1342,11 +1369,11 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
                 assert(a.isStoredAsInteger());
                 assert(b.isStoredAsInteger());
                 if ((a.value.iv > b.value.iv) == isGt){
-                    logd("if_icmple/if_icmpgt Jumping! isGt=", isGt);
+                    logt("if_icmple/if_icmpgt Jumping! isGt=", isGt);
                     pc = pc + target;
                     continue;
                 } else {
-                    logd("No jump");
+                    logt("No jump");
                 }
                 pc+=2;
                 break;
@@ -1389,11 +1416,11 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
                 break;
             }
             case ops::monitorenter:
-                logd("TODO: Monitor enter not supported");
+                logt("TODO: Monitor enter not supported");
                 frame.stack.pop();
             break;
             case ops::monitorexit:
-                logd("TODO: Monitor exit not supported");
+                logt("TODO: Monitor exit not supported");
                 frame.stack.pop();
             break;
             case ops::athrow: {
@@ -1412,7 +1439,7 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
                 pc ++; // go away from current instruction
                 ssize_t currentDelta = pc - bytes.begin;
                 size_t pad = (4 - currentDelta % 4) % 4;
-                logd("Lookupswitch, pad = ", pad);
+                logt("Lookupswitch, pad = ", pad);
                 pc += pad;
                 ssize_t afterDelta = pc - bytes.begin;
                 assert(afterDelta % 4 == 0);
@@ -1422,13 +1449,13 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
                 assert (nPairs >= 0);
 
                 pc += 8;
-                logd("Number of pairs ", nPairs);
+                logt("Number of pairs ", nPairs);
                 bool found = false;
                 for (int32_t i = 0 ; i < nPairs; i++){
                     int32_t v = bytes.fetchInt32(pc);
                     int32_t jumpAddressOffset = bytes.fetchInt32(pc + 4);
                     if (v == key.value.iv){
-                        logd("lookupswitch jump at ", v);
+                        logt("lookupswitch jump at ", v);
                         pc = baseAddress + jumpAddressOffset;
                         found = true;
                         break;
@@ -1438,11 +1465,33 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
                 if (found){
                     continue;
                 }
-                logd("Not found, jump using default delta");
+                logt("Not found, jump using default delta");
                 pc = baseAddress + defaultValue;
                 continue;
                 break;
             }
+            case ops::tableswitch: {
+                auto baseAddress = pc;
+
+                Variable index = frame.stack.pop();
+                assert(index.isStoredAsInteger());
+                // Table starts 4 byte aligned after the op code
+                pc ++;
+                ssize_t currentDelta = pc - bytes.begin;
+                pc += (4 - currentDelta % 4) % 4;
+
+                int32_t defaultValue = bytes.fetchInt32(pc);
+                int32_t low = bytes.fetchInt32(pc + 4);
+                int32_t high = bytes.fetchInt32(pc + 8);
+                assert (low <= high);
+                if (index.value.iv < low || index.value.iv > high){
+                    pc = baseAddress + defaultValue;
+                    continue;
+                }
+                int64_t entry = (int64_t) index.value.iv - low;
+                pc = baseAddress + bytes.fetchInt32(pc + 12 + 4 * entry);
+                continue;
+            }
             default:
                 throw std::invalid_argument(std::string("Unsupported file, opcode=") + ops::opToStr(op));
         }
@@ -1450,8 +1499,7 @@ Variable Interpreter::executeMethod(const ClassFile &clazz, const MethodInfo& me
 
         pc++;
     }
-    logi("Leaving... ");
-    return Variable();
+    return false;
 }
 
 Variable Interpreter::callStatic(const std::string &className, const std::string &methodName,
@@ -1462,20 +1510,24 @@ Variable Interpreter::callStatic(const std::string &className, const std::string
 }
 
 Variable Interpreter::classByName(const std::string& name){
-    Variable className = initializeString(name, Frame());
-
     logd("classByName ", name);
+    // Initializing may execute bytecode, the name string must not be collected meanwhile
     auto clazz = findInitializedClass("java/lang/Class");
+    Variable className = initializeString(name, Frame());
     Variable result = mMemory.allocateObject(clazz);
 
-    result.value.object->fields["__name"] = className;
+    *result.value.object->publicField("__name") = className;
 
     return result;
 }
 
 ClassFilePtr Interpreter::findInitializedClass(const std::string &name) {
+    return findInitializedClass(Symbol::intern(name));
+}
+
+ClassFilePtr Interpreter::findInitializedClass(const Symbol* name) {
     auto result = classLoader().loadByName(name);
-    if (mInitializedClasses.count(name) > 0){
+    if (mInitializedClasses.count(result->nameSymbol()) > 0){
         return result;
     }
     auto superClass = result->superClass();
@@ -1488,6 +1540,61 @@ ClassFilePtr Interpreter::findInitializedClass(const std::string &name) {
     return result;
 }
 
+void Interpreter::invokeDirect(Frame& frame, const ResolvedReference& method) {
+    auto argCount = method.descriptor.argumentCount();
+    if (!(method.method->accessFlags & Flags::STATIC)){
+        // including this pointer
+        argCount++;
+    }
+    // arguments are in same order like on stack
+    Variable* args = frame.stack.popMany(argCount);
+    Variable result = executeMethod(*method.clazz, *method.method, frame, args, argCount);
+    handleReturn(&frame, result, method.descriptor);
+}
+
+void Interpreter::invokeVirtual(Frame& frame, const ResolvedReference& method) {
+    const auto& desc = method.descriptor;
+    Variable thisPointer = frame.stack.top(desc.argumentCount());
+
+    logt("Looking for ", method.methodIdentifier.methodName->str(), "of", method.methodIdentifier.className->str());
+    VirtualMethod target = virtualMethodDispatch(method, thisPointer);
+    logt("Found virtual method ", method.methodIdentifier.methodName->str(), "in", target.clazz->name());
+
+    // arguments are in same order like on stack, adding argCount and this pointer (which is alredy placed)
+    Variable* args = frame.stack.popMany(desc.argumentCount() + 1);
+
+    logt("Invoking ", method.methodIdentifier.toString(), "Arg count", desc.argumentCount());
+    Variable result = executeMethod(*target.clazz, *target.method, frame, args, desc.argumentCount() + 1);
+    handleReturn(&frame, result, desc);
+}
+
+void Interpreter::invokeCached(Frame& frame, InlineCache& cache) {
+    const ResolvedReference& method = *cache.reference;
+    const auto& desc = method.descriptor;
+    const Variable& thisPointer = frame.stack.top(desc.argumentCount());
+    if (thisPointer.type != ObjectRef || thisPointer.value.object == nullptr){
+        invokeVirtual(frame, method);
+        return;
+    }
+
+    const ClassFile* receiver = thisPointer.value.object->type.get();
+    const PreparedMethod* target = cache.megamorphic ? nullptr : cache.lookup(receiver);
+    if (target){
+        cache.hits++;
+    } else {
+        cache.misses++;
+        VirtualMethod found = virtualMethodDispatch(method, thisPointer);
+        target = &prepareMethod(*found.clazz, *found.method);
+        if (!cache.megamorphic){
+            cache.add(receiver, target);
+        }
+    }
+
+    Variable* args = frame.stack.popMany(desc.argumentCount() + 1);
+    Variable result = executePrepared(*target, frame, args, desc.argumentCount() + 1);
+    handleReturn(&frame, result, desc);
+}
+
 void Interpreter::handleReturn(Frame *frame, Variable returnValue, const DescriptorParser &methodSignature) {
     VariableType expectedType = methodSignature.type();
     if (returnMemoryType(expectedType) != returnMemoryType(returnValue.type)){
@@ -1499,24 +1606,24 @@ void Interpreter::handleReturn(Frame *frame, Variable returnValue, const Descrip
 }
 
 void Interpreter::prepareClazz(const ClassFilePtr &clazz) {
-    auto fields = clazz->fields();
+    const auto& fields = clazz->fields();
     for (const auto& field: fields){
         if (!field.isStatic){
             continue;
         }
-        logd("Initializing static field ", field.name);
-        DescriptorParser parser(field.descriptor);
+        logd("Initializing static field ", field.name->str());
+        DescriptorParser parser(field.descriptor->str());
         if (parser.isMethod()){
-            throw std::invalid_argument("Expected a field, not a method for " + clazz->name() + "/" + field.name + " description: " + field.descriptor);
+            throw std::invalid_argument("Expected a field, not a method for " + clazz->name() + "/" + field.name->str() + " description: " + field.descriptor->str());
         }
-        mMemory.initGlobal(clazz->name(), field.name, parser.type());
+        mMemory.initGlobal(GlobalVariableIdentifier { clazz->nameSymbol(), field.name }, parser.type());
     }
     logd("Prepared ", fields.size(), " fields for ", clazz->name());
 }
 
 void Interpreter::initClass(const ClassFilePtr &clazz) {
     // Adding it before, even if it's not yet initialized in order to avoid initializing loops.
-    mInitializedClasses.insert(clazz->name());
+    mInitializedClasses.insert(clazz->nameSymbol());
     // Run static initializer
     auto initializer = clazz->clinit();
     if (initializer){
@@ -1527,21 +1634,221 @@ void Interpreter::initClass(const ClassFilePtr &clazz) {
     }
 }
 
-std::pair<ClassFilePtr, MethodInfo> Interpreter::virtualMethodDispatch(const MethodIdentifier &method, const Variable &thisPointer) {
+const PreparedMethod& Interpreter::prepareMethod(const ClassFile& clazz, const MethodInfo& method) {
+    const PreparedMethod* existing = clazz.preparedMethod(method);
+    if (existing){
+        return *existing;
+    }
+    const Symbol* descriptor = clazz.symbol(method.descriptorIdx);
+    std::shared_ptr<PreparedMethod> prepared = std::make_shared<PreparedMethod>(descriptor->str());
+    prepared->clazz = &clazz;
+    prepared->methodName = clazz.symbol(method.nameIdx);
+    prepared->descriptorSymbol = descriptor;
+    prepared->isStatic = (bool)(method.accessFlags & Flags::STATIC);
+    prepared->isNative = method.isNative();
+    prepared->hasCode = !prepared->isNative && !(method.accessFlags & Flags::ABSTRACT);
+    if (prepared->hasCode){
+        prepared->code = clazz.codeForMethod(method);
+    }
+
+    MethodOverrideIdentifier identifier;
+    identifier.className = clazz.nameSymbol();
+    identifier.methodName = prepared->methodName;
+    identifier.description = descriptor;
+    prepared->override = mMethodOverrides->find(identifier);
+    return *clazz.setPreparedMethod(method, prepared);
+}
+
+const ResolvedReference& Interpreter::resolveMethod(const ClassFile& clazz, uint16_t index) {
+    ResolvedReference* resolved = clazz.resolvedReference(index);
+    if (resolved && resolved->method){
+        return *resolved;
+    }
+    bool isInterfaceMethod = clazz.constantEntry(index).tag == ConstantEntry::InterfaceMethodRefTag;
+    MethodIdentifier identifier = isInterfaceMethod ? clazz.findInterfaceMethod(index) : clazz.findMethod(index);
+
+    // Methods may be inherited from a super class
+    ClassFilePtr current = findInitializedClass(identifier.className);
+    const MethodInfo * method = nullptr;
+    while (current && (method = current->lookupMethod(identifier)) == nullptr){
+        current = current->superClassFile().lock();
+    }
+    if (method == nullptr){
+        throw std::invalid_argument("Could not resolve method " + identifier.toString());
+    }
+
+    // The same entry may be used for virtual calls or already be resolved during class initialization
+    resolved = clazz.resolvedReference(index);
+    if (!resolved){
+        std::unique_ptr<ResolvedReference> reference (new ResolvedReference(identifier.descriptor->str()));
+        reference->methodIdentifier = identifier;
+        resolved = clazz.setResolvedReference(index, std::move(reference));
+    }
+    resolved->clazz = current.get();
+    resolved->method = method;
+    return *resolved;
+}
+
+const ResolvedReference& Interpreter::resolveVirtualMethod(const ClassFile& clazz, uint16_t index, bool isInterfaceMethod) {
+    const ResolvedReference* resolved = clazz.resolvedReference(index);
+    if (resolved){
+        return *resolved;
+    }
+    MethodIdentifier identifier = isInterfaceMethod ? clazz.findInterfaceMethod(index) : clazz.findMethod(index);
+    std::unique_ptr<ResolvedReference> reference (new ResolvedReference(identifier.descriptor->str()));
+    reference->methodIdentifier = identifier;
+
+    // Methods on arrays are the ones of java/lang/Object
+    const std::string& className = identifier.className->str();
+    ClassFilePtr referenced = mClassLoader.loadByName(className[0] == '[' ? "java/lang/Object" : className);
+    if (referenced->isInterface()){
+        // The method may be declared in a super interface
+        std::vector<ClassFilePtr> candidates { referenced };
+        for (size_t i = 0; i < candidates.size() && !reference->interfaceClass; i++){
+            int itableIndex = candidates[i]->interfaceMethodIndex(identifier.methodName, identifier.descriptor);
+            if (itableIndex >= 0){
+                reference->interfaceClass = candidates[i].get();
+                reference->itableIndex = itableIndex;
+            }
+            const auto& superInterfaces = candidates[i]->interfaceFiles();
+            candidates.insert(candidates.end(), superInterfaces.begin(), superInterfaces.end());
+        }
+        if (!reference->interfaceClass){
+            // Public methods of java/lang/Object are also callable on interfaces
+            referenced = mClassLoader.loadByName("java/lang/Object");
+        }
+    }
+    if (!referenced->isInterface()){
+        reference->vtableIndex = referenced->vtableIndex(identifier.methodName, identifier.descriptor);
+    }
+    return *clazz.setResolvedReference(index, std::move(reference));
+}
+
+const ResolvedReference& Interpreter::resolveField(const ClassFile& clazz, uint16_t index) {
+    const ResolvedReference* resolved = clazz.resolvedReference(index);
+    if (resolved){
+        return *resolved;
+    }
+    FieldRefIdentifier identifier = clazz.findFieldRefIdentifier(index);
+
+    // Fields may be declared in a super class
+    ClassFilePtr current = mClassLoader.loadByName(identifier.className);
+    const FieldInfo * field = nullptr;
+    while (current && (field = current->lookupField(identifier.fieldName)) == nullptr){
+        current = current->superClassFile().lock();
+    }
+    if (field == nullptr){
+        throw std::invalid_argument("Could not resolve field " + identifier.toString());
+    }
+    if (field->accessFlags & Flags::STATIC){
+        throw std::invalid_argument("Expected an instance field for " + identifier.toString());
+    }
+    std::unique_ptr<ResolvedReference> reference (new ResolvedReference(identifier.descriptor->str()));
+    reference->clazz = current.get();
+    reference->fieldKey = current->instanceFields()[field->slot].key;
+    reference->fieldSlot = field->slot;
+    return *clazz.setResolvedReference(index, std::move(reference));
+}
+
+/** Class or interface declaring a field, searched like JVMS 5.4.3.2: the class itself, its super interfaces, then its super class. */
+static ClassFilePtr findFieldDeclaration(const ClassFilePtr& clazz, const Symbol* fieldName) {
+    if (clazz->lookupField(fieldName)){
+        return clazz;
+    }
+    for (const auto& superInterface : clazz->interfaceFiles()){
+        ClassFilePtr found = findFieldDeclaration(superInterface, fieldName);
+        if (found){
+            return found;
+        }
+    }
+    ClassFilePtr superClass = clazz->superClassFile().lock();
+    return superClass ? findFieldDeclaration(superClass, fieldName) : ClassFilePtr();
+}
+
+const ResolvedReference& Interpreter::resolveStaticField(const ClassFile& clazz, uint16_t index) {
+    const ResolvedReference* resolved = clazz.resolvedReference(index);
+    if (resolved){
+        return *resolved;
+    }
+    FieldRefIdentifier identifier = clazz.findFieldRefIdentifier(index);
+
+    ClassFilePtr current = findFieldDeclaration(findInitializedClass(identifier.className), identifier.fieldName);
+    if (!current){
+        throw std::invalid_argument("Could not resolve static field " + identifier.toString());
+    }
+    if (current->isInterface()){
+        // Initializing a class does not initialize its interfaces
+        findInitializedClass(current->nameSymbol());
+    }
+    std::unique_ptr<ResolvedReference> reference (new ResolvedReference(identifier.descriptor->str()));
+    reference->clazz = current.get();
+    reference->staticField = mMemory.globalSlot(GlobalVariableIdentifier { current->nameSymbol(), identifier.fieldName });
+
+    resolved = clazz.resolvedReference(index);
+    return resolved ? *resolved : *clazz.setResolvedReference(index, std::move(reference));
+}
+
+VirtualMethod Interpreter::virtualMethodDispatch(const ResolvedReference& method, const Variable &thisPointer) {
+    assert(thisPointer.type == ObjectRef);
+    if (thisPointer.value.object == nullptr){
+        throw std::invalid_argument("Calling " + method.methodIdentifier.toString() + " on null");
+    }
+    const ClassFile& receiver = *thisPointer.value.object->type;
+    const VirtualMethod* target = nullptr;
+    if (method.vtableIndex >= 0){
+        target = &receiver.vtable()[method.vtableIndex];
+    } else if (method.interfaceClass){
+        target = receiver.interfaceMethod(method.interfaceClass, method.itableIndex);
+    }
+    if (target && target->method){
+        return *target;
+    }
+    return virtualMethodDispatch(method.methodIdentifier, thisPointer);
+}
+
+VirtualMethod Interpreter::virtualMethodDispatch(const MethodIdentifier &method, const Variable &thisPointer) {
     assert(thisPointer.type == ObjectRef);
     ClassFilePtr current = thisPointer.value.object->type;
     while (current){
-        boost::optional<MethodInfo> info = current->methodWithSignature(method);
+        const MethodInfo * info = current->lookupMethod(method);
         if (info){
-            return std::make_pair(current, info.get());
-        }
-        boost::optional<std::string> superClass = current->superClass();
-        if (!superClass){
-            break;
+            VirtualMethod result;
+            result.clazz = current.get();
+            result.method = info;
+            return result;
         }
-        current = findInitializedClass(superClass.get());
+        current = current->superClassFile().lock();
+    }
+    throw std::invalid_argument("Could not find method " + method.className->str() + "/" + method.methodName->str() + " in " + thisPointer.value.object->type->name());
+}
+
+const ResolvedReference& Interpreter::resolveString(const ClassFile& clazz, uint16_t index, const Frame& frame) {
+    ResolvedReference* existing = clazz.resolvedReference(index);
+    if (existing){
+        return *existing;
+    }
+    const ConstantEntry& constant = clazz.constantEntry(index);
+    assert(constant.tag == ConstantEntry::StringTag);
+    std::unique_ptr<ResolvedReference> reference (new ResolvedReference("Ljava/lang/String;"));
+    reference->string = internString(clazz.getUtf8Constant(constant.nameIndex()), frame).value.object;
+    return *clazz.setResolvedReference(index, std::move(reference));
+}
+
+Variable Interpreter::internString(const std::string& content, const Frame& previousFrame) {
+    std::u16string key = stringutils::utf8ToUtf16(content);
+    auto i = mInternedStrings.find(key);
+    if (i != mInternedStrings.end()){
+        return i->second;
     }
-    throw std::invalid_argument("Could not find method " + method.className + "/" + method.methodName + " in " + thisPointer.value.object->type->name());
+    Variable string = initializeString(content, previousFrame);
+    mInternedStrings[key] = string;
+    return string;
+}
+
+Variable Interpreter::intern(const Variable& string) {
+    // Keeps the first instance with this content
+    auto inserted = mInternedStrings.insert(std::make_pair(string.utf16StringValue(), string));
+    return inserted.first->second;
 }
 
 Variable Interpreter::initializeString(const std::string &content, const Frame& previousFrame) {
@@ -1555,16 +1862,16 @@ Variable Interpreter::initializeString(const std::string &content, const Frame&
     auto charArray = mMemory.allocateArray(Char, utf16.length());
 
 
-    for (size_t i = 0; i < utf16.length(); i++){
-        charArray.array()->values[i].iv  = utf16[i];
-    }
+    std::copy(utf16.begin(), utf16.end(), charArray.array()->data<uint16_t>());
 
 
 
+    static const Symbol* Init = Symbol::intern("<init>");
+    static const Symbol* CharArrayConstructor = Symbol::intern("([C)V");
     MethodIdentifier identifier;
-    identifier.className = "jx/lang/String";
-    identifier.descriptor = "([C)V";
-    identifier.methodName = "<init>";
+    identifier.className = stringClass->nameSymbol();
+    identifier.descriptor = CharArrayConstructor;
+    identifier.methodName = Init;
 
 
     MethodInfo info = stringClass->methodWithSignature(identifier).get();
@@ -1580,6 +1887,9 @@ Variable Interpreter::initializeString(const std::string &content, const Frame&
 void Interpreter::createMainThread() {
     auto threadClass = findInitializedClass("java/lang/Thread");
     auto threadGroupClass = findInitializedClass("java/lang/ThreadGroup");
+    // Interned, so it stays reachable while the thread group is initialized
+    Variable mainThreadName = internString("main", Frame());
+
     Variable threadGroup = mMemory.allocateObject(threadGroupClass);
     MethodInfo threadGroupInit = threadGroupClass->methodWithName("<init>").get();
     Variables initArgs;
@@ -1592,12 +1902,10 @@ void Interpreter::createMainThread() {
     assert(prioField);
     prioField->value.iv = 5;
 
-
-    Variable mainThreadName = initializeString("main", Frame());
-
     MethodIdentifier identifier;
-    identifier.methodName = "<init>";
-    identifier.descriptor = "(Ljava/lang/ThreadGroup;Ljava/lang/String;)V";
+    identifier.className = threadClass->nameSymbol();
+    identifier.methodName = Symbol::intern("<init>");
+    identifier.descriptor = Symbol::intern("(Ljava/lang/ThreadGroup;Ljava/lang/String;)V");
     MethodInfo threadInitMethod = threadClass->methodWithSignature(identifier).get();
     Variables threadInitArgs;
     threadInitArgs.push(mMainThread);
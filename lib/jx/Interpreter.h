@@ -7,9 +7,12 @@
 #include "Variable.h"
 #include "Util.h"
 #include "VmMemory.h"
+#include "VmStack.h"
 #include "DescriptorParser.h"
+#include "StackSampler.h"
+#include <functional>
 
-// Some variables (e.g. Frame / Heap / Argument list).
+// Argument list for calls from C++ (e.g. method overrides).
 struct Variables {
     std::vector<Variable> variables;
 
@@ -32,29 +35,230 @@ struct Variables {
         variables.resize(variables.size() - count);
     }
 
-    std::vector<Variable> popAndReturnMany(size_t count){
-        if (count > variables.size()){
-            throw std::invalid_argument("Count bigger than vector size");
+    Variable pop() { Variable v = top(); variables.pop_back(); return v; }
+};
+
+/** Operand stack of a frame, lives inside the VmStack. */
+struct OperandStack {
+    Variable* base = nullptr;
+    // Next free slot
+    Variable* sp = nullptr;
+
+    bool empty() const { return sp == base; }
+
+    size_t size() const { return sp - base; }
+
+    void push(const Variable& variable) { *sp++ = variable; }
+
+    Variable pop() { assert(sp > base); return *--sp; }
+
+    const Variable& top() const { return *(sp - 1); }
+
+    /** Returns objects indexed from the top of the stack. */
+    const Variable& top(size_t idx) const { return *(sp - 1 - idx); }
+
+    /** Pops count elements, returns the first of them. They stay valid until the next push. */
+    Variable* popMany(size_t count) {
+        if (count > size()){
+            throw std::invalid_argument("Count bigger than stack size");
         }
-        std::vector<Variable> result (variables.end() - count, variables.end());
-        variables.resize(variables.size() - count);
-        return result;
+        sp -= count;
+        return sp;
     }
+};
 
-    Variable pop() { Variable v = top(); variables.pop_back(); return v; }
+/** Implements the <x>aload op codes, T is the element type of the array, type the one of the pushed value. */
+template <typename T>
+inline void arrayLoad(OperandStack& stack, VariableType type) {
+    Variable index = stack.pop();
+    Variable arrayRef = stack.pop();
+    assert(index.isStoredAsInteger());
+    assert(arrayRef.isArray());
+    assert(index.value.iv >= 0 && (uint32_t) index.value.iv < arrayRef.array()->length);
+    Variable result (type);
+    Array::toValue(result.value, arrayRef.array()->at<T>(index.value.iv));
+    stack.push(result);
+}
+
+/** Implements the <x>astore op codes, T is the element type of the array. */
+template <typename T>
+inline void arrayStore(OperandStack& stack) {
+    Variable value = stack.pop();
+    Variable index = stack.pop();
+    Variable arrayRef = stack.pop();
+    assert(index.isStoredAsInteger());
+    assert(arrayRef.isArray());
+    assert(index.value.iv >= 0 && (uint32_t) index.value.iv < arrayRef.array()->length);
+    arrayRef.array()->at<T>(index.value.iv) = Array::fromValue<T>(value.value);
+}
+
+/** Local variables of a frame, lives inside the VmStack. Method overrides get their arguments this way. */
+struct LocalArray {
+    Variable* variables = nullptr;
+    size_t count = 0;
+
+    bool empty() const { return count == 0; }
+
+    size_t size() const { return count; }
 };
 
+class MethodOverrides;
+struct MethodOverride;
+struct FunctionContext;
+struct PreparedMethod;
+
 struct Frame {
     Object *thisp = 0;
+    /** Frame of the calling method, for walking the Java stack (e.g. for garbage collection). */
+    Frame* caller = nullptr;
+    /** Executed method, null for frames of C++ callers. */
+    const PreparedMethod* method = nullptr;
 
-    // TODO, necessary?
+    // Bytecode is verified by javac, but we don't verify it on our own.
     void ensureLocalArraySpace(int idx);
 
-    Variables stack;
-    Variables localArray;
+    OperandStack stack;
+    LocalArray localArray;
 };
 
-class MethodOverrides;
+class Profiler;
+
+/** Receiver class to target cache of an invokevirtual/invokeinterface site of the threaded interpreter.
+    Starts monomorphic, grows up to Capacity receiver classes and then becomes megamorphic,
+    using the vtable/interface tables of the receiver on each call. */
+struct InlineCache {
+    static const size_t Capacity = 4;
+
+    const ResolvedReference* reference = nullptr;
+    const ClassFile* receivers[Capacity] = {};
+    const PreparedMethod* targets[Capacity] = {};
+    size_t size = 0;
+    bool megamorphic = false;
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    /** Byte offset of the call site. */
+    uint32_t pc = 0;
+
+    const PreparedMethod* lookup(const ClassFile* receiver) const {
+        for (size_t i = 0; i < size; i++){
+            if (receivers[i] == receiver){
+                return targets[i];
+            }
+        }
+        return nullptr;
+    }
+
+    void add(const ClassFile* receiver, const PreparedMethod* target) {
+        if (size == Capacity){
+            megamorphic = true;
+            return;
+        }
+        receivers[size] = receiver;
+        targets[size] = target;
+        size++;
+    }
+};
+
+enum InlineCacheState {
+    Monomorphic,
+    Polymorphic,
+    Megamorphic
+};
+
+/** Counters of a call site, see Interpreter::callSiteStats. */
+struct CallSiteStats {
+    std::string className;
+    std::string methodName;
+    uint32_t pc = 0;
+    /** Called method as referenced in the byte code. */
+    std::string callee;
+    InlineCacheState state = Monomorphic;
+    size_t receiverCount = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
+
+/** A pre-decoded instruction of the threaded interpreter (see Interpreter::executeThreaded).
+    After the first execution, instructions referencing the constant pool are rewritten
+    to quick variants, carrying the resolved entry. */
+struct Instruction {
+    Instruction() : target(nullptr) {}
+
+    /** Address of the handler label. */
+    const void* handler = nullptr;
+    union {
+        /** Branch target. */
+        Instruction* target;
+        /** Resolved method reference (invokedirect_quick). */
+        const ResolvedReference* reference;
+        /** Call site cache (invokevirtual_quick), owned by ThreadedCode. */
+        InlineCache* cache;
+        /** Initialized class (new_quick). */
+        ClassFile* clazz;
+        /** Storage of a static field (getstatic_quick/putstatic_quick). */
+        Variable* staticField;
+        /** String constant (ldc_quick). */
+        Object* object;
+    };
+    /** Decoded operand, e.g. local variable index, constant, constant pool index or field slot. */
+    int32_t operand = 0;
+    /** Second operand, e.g. the increment of iinc. */
+    int32_t operand2 = 0;
+    /** Byte offset inside the code attribute. */
+    uint32_t pc = 0;
+    uint8_t op = 0;
+};
+
+/** Method code translated for the threaded interpreter. */
+struct ThreadedCode {
+    /** Ends with a sentinel for leaving the method at the end of the code. */
+    std::vector<Instruction> instructions;
+    /** Index into instructions for each byte offset (including the end), -1 inside of instructions. */
+    std::vector<int32_t> indexByPc;
+    /** One per invokevirtual/invokeinterface, allocated upfront so that instructions can point to them. */
+    std::vector<InlineCache> inlineCaches;
+
+    Instruction* atPc(size_t pc) {
+        int32_t index = indexByPc[pc];
+        if (index < 0){
+            throw std::invalid_argument("Jump into the middle of an instruction");
+        }
+        return &instructions[index];
+    }
+};
+
+/** Immutable interpreter view of a method, built once on the first call. */
+struct PreparedMethod {
+    PreparedMethod(const std::string& descriptor) : descriptor(descriptor) {}
+
+    const ClassFile* clazz = nullptr;
+
+    const Symbol* methodName = nullptr;
+    const Symbol* descriptorSymbol = nullptr;
+    DescriptorParser descriptor;
+
+    bool isStatic = false;
+    bool isNative = false;
+
+    /** False for abstract methods. */
+    bool hasCode = false;
+    CodeIdentifier code;
+
+    /** C++ replacement, owned by MethodOverrides, null if there is none. */
+    const MethodOverride* override = nullptr;
+
+    /** Built by the threaded interpreter on the first execution. */
+    mutable std::unique_ptr<ThreadedCode> threadedCode;
+};
+
+/** Engine executing the bytecode. */
+enum DispatchMode {
+    /** Switch over each byte code, the reference implementation. */
+    SwitchDispatch,
+    /** Computed goto over pre-decoded instructions, needs JX_THREADED_DISPATCH. */
+    ThreadedDispatch
+};
 
 class JvmException : public std::exception {
 public:
@@ -74,27 +278,106 @@ class Interpreter {
 public:
     Interpreter();
     ClassLoader& classLoader() { return mClassLoader; }
+    VmMemory& memory() { return mMemory; }
 
     /** Execute a given file */
     void executeFile(const std::string& filename);
 
     void executeMain(const ClassFile& clazz);
     Variable executeMethod(const ClassFile& clazz, const MethodInfo& method, const Frame& previousFrame, const Variables& arguments);
+    /** Executes a method with the arguments already placed on the VmStack (e.g. on the operand stack of the caller). */
+    Variable executeMethod(const ClassFile& clazz, const MethodInfo& method, const Frame& previousFrame, Variable* arguments, size_t argumentCount);
+
+    /** Executes a prepared method, see executeMethod. */
+    Variable executePrepared(const PreparedMethod& prepared, const Frame& previousFrame, Variable* arguments, size_t argumentCount);
 
-    std::pair<ClassFilePtr, MethodInfo> virtualMethodDispatch(const MethodIdentifier& method, const Variable& thisPointer);
+    /** Finds the implementation of a resolved virtual/interface method, using vtable or interface tables. */
+    VirtualMethod virtualMethodDispatch(const ResolvedReference& method, const Variable& thisPointer);
+    /** Slow path, walks the class hierarchy of the receiver. */
+    VirtualMethod virtualMethodDispatch(const MethodIdentifier& method, const Variable& thisPointer);
 
     Variable mainThread() const { return mMainThread; }
 
+    /** Selects the interpreter engine, defaults to ThreadedDispatch if compiled in. */
+    void setDispatchMode(DispatchMode mode);
+    DispatchMode dispatchMode() const { return mDispatchMode; }
+
+    /** Reports execution to the given profiler (not owned), null turns profiling off again.
+        While profiling, methods run on the switch engine which counts each instruction. */
+    void setProfiler(Profiler* profiler) { mProfiler = profiler; }
+    Profiler* profiler() const { return mProfiler; }
+
+    /** Samples the Java stack into the given sampler (not owned), null turns sampling off again. */
+    void setStackSampler(StackSampler* sampler) { mStackSampler = sampler; }
+    StackSampler* stackSampler() const { return mStackSampler; }
+
+    /** Instructions executed by the switch engine. */
+    uint64_t instructionCount() const { return mInstructionCount; }
+
+    /** Inline cache counters of all invokevirtual/invokeinterface sites executed by the threaded interpreter. */
+    std::vector<CallSiteStats> callSiteStats() const;
+
     // Convenience, call a static method
     Variable callStatic(const std::string& className, const std::string& methodName, const Variables& arguments);
 
     Variable classByName(const std::string& clazzName);
 
+    /** Returns the interned java/lang/String with the given content, creating it if necessary. */
+    Variable internString(const std::string& content, const Frame& previousFrame);
+    /** Implementation of String.intern, returns the interned string equal to the given one. */
+    Variable intern(const Variable& string);
+
     ClassFilePtr findInitializedClass(const std::string& name);
+    ClassFilePtr findInitializedClass(const Symbol* name);
+
+    /** Frees all objects not reachable from the Java stack, globals, interned strings and the main thread.
+        Variables held by C++ code only are not roots, so this is only safe between bytecodes. */
+    void collectGarbage();
 
 private:
+    /** Links a frame as the top of the Java stack for its lifetime. */
+    class FrameScope;
+
+    /** Collects garbage if the heap grew enough, called by allocating bytecodes before they touch the operand stack. */
+    void safepoint() {
+        if (mMemory.needsCollection()){
+            collectGarbage();
+        }
+    }
+
+    /** Takes a due stack sample, polled at method entry, taken branches and by the switch engine. */
+    void pollStackSampler() {
+        if (mStackSampler && mStackSampler->sampleDue()){
+            mStackSampler->takeSample(mTopFrame);
+        }
+    }
+
     void handleReturn(Frame* frame, Variable returnValue, const DescriptorParser& methodSignature);
 
+    Variable executeSwitch(Frame& frame, const ClassFile& clazz, const PreparedMethod& prepared);
+    /** Executes a single instruction and advances pc, returns true if the method returned. */
+    bool executeInstruction(Frame& frame, const ClassFile& clazz, const ByteRange& bytes, ByteRange::Iterator& pc, Variable& returnValue);
+    /** Runs the switch engine from pc until the method returns (true, with returnValue set), or for one instruction if singleStep. */
+    bool runSwitch(Frame& frame, const ClassFile& clazz, const ByteRange& bytes, ByteRange::Iterator& pc, Variable& returnValue, bool singleStep);
+#ifdef JX_THREADED_DISPATCH
+    Variable executeThreaded(Frame& frame, const ClassFile& clazz, const PreparedMethod& prepared);
+    std::unique_ptr<ThreadedCode> translate(const PreparedMethod& prepared, const void* const* handlers, const void* genericHandler, const void* endHandler);
+#endif
+
+    // Invocation of resolved methods, arguments are taken from the operand stack.
+    void invokeDirect(Frame& frame, const ResolvedReference& method);
+    void invokeVirtual(Frame& frame, const ResolvedReference& method);
+    void invokeCached(Frame& frame, InlineCache& cache);
+
+    // Linking of constant pool references, done once per constant pool entry.
+    const ResolvedReference& resolveMethod(const ClassFile& clazz, uint16_t index);
+    const ResolvedReference& resolveVirtualMethod(const ClassFile& clazz, uint16_t index, bool isInterfaceMethod);
+    const ResolvedReference& resolveField(const ClassFile& clazz, uint16_t index);
+    const ResolvedReference& resolveStaticField(const ClassFile& clazz, uint16_t index);
+    const ResolvedReference& resolveString(const ClassFile& clazz, uint16_t index, const Frame& frame);
+
+
+    const PreparedMethod& prepareMethod(const ClassFile& clazz, const MethodInfo& method);
 
     void prepareClazz(const ClassFilePtr& clazz);
     void initClass(const ClassFilePtr& clazz);
@@ -105,11 +388,21 @@ private:
 
     ClassLoader mClassLoader;
 
-    std::unordered_set<std::string> mInitializedClasses;
+    std::unordered_set<const Symbol*, hash::SymbolHash> mInitializedClasses;
     std::shared_ptr<MethodOverrides> mMethodOverrides;
     VmMemory mMemory;
+    VmStack mStack;
+    /** Innermost frame executed, null outside of the interpreter. */
+    Frame* mTopFrame = nullptr;
+    /** String constants and String.intern results, by content. */
+    std::unordered_map<std::u16string, Variable> mInternedStrings;
+    DispatchMode mDispatchMode;
 
     uint64_t mInstructionCount;
+    Profiler* mProfiler = nullptr;
+    StackSampler* mStackSampler = nullptr;
+    /** Methods with threaded code, for collecting the call site stats. */
+    std::vector<const PreparedMethod*> mTranslatedMethods;
 
     Variable mMainThread;
 };
\ No newline at end of file
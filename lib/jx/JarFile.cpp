@@ -0,0 +1,154 @@
+#include "JarFile.h"
+#include <boost/filesystem.hpp>
+#include <zlib.h>
+
+namespace {
+
+const uint32_t EndOfCentralDirectorySignature = 0x06054b50;
+const uint32_t CentralDirectorySignature = 0x02014b50;
+const uint32_t LocalHeaderSignature = 0x04034b50;
+const size_t EndOfCentralDirectorySize = 22;
+const size_t CentralDirectoryEntrySize = 46;
+const size_t LocalHeaderSize = 30;
+const size_t MaxCommentSize = 0xffff;
+
+const uint16_t Stored = 0;
+const uint16_t Deflated = 8;
+
+// Zip is little endian
+uint16_t read16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+uint32_t read32(const uint8_t* p) {
+    return read16(p) | ((uint32_t) read16(p + 2) << 16);
+}
+
+}
+
+JarFile::JarFile(const std::string& path) : mPath(path) {
+    if (!boost::filesystem::exists(path)){
+        throw std::invalid_argument("Could not open " + path);
+    }
+}
+
+void JarFile::checkRange(uint64_t offset, uint64_t length) const {
+    if (offset + length > mSize){
+        throw std::invalid_argument("Broken jar " + mPath);
+    }
+}
+
+void JarFile::open() const {
+    boost::iostreams::mapped_file_params params;
+    params.path = mPath;
+    params.flags = boost::iostreams::mapped_file_base::readonly;
+    try {
+        mMappedFile.open(params);
+    } catch (std::exception& e){
+        throw std::invalid_argument("Could not open " + mPath + ": " + e.what());
+    }
+    mData = reinterpret_cast<const uint8_t*>(mMappedFile.data());
+    mSize = mMappedFile.size();
+
+    // The end of central directory record is followed by a comment of up to 64k
+    if (mSize < EndOfCentralDirectorySize){
+        throw std::invalid_argument("Broken jar " + mPath);
+    }
+    size_t end = mSize - EndOfCentralDirectorySize;
+    size_t lowest = end > MaxCommentSize ? end - MaxCommentSize : 0;
+    while (read32(mData + end) != EndOfCentralDirectorySignature){
+        if (end == lowest){
+            throw std::invalid_argument("Broken jar " + mPath + ", no central directory");
+        }
+        end--;
+    }
+    uint16_t entryCount = read16(mData + end + 10);
+    uint32_t directorySize = read32(mData + end + 12);
+    uint32_t directoryOffset = read32(mData + end + 16);
+    if (read16(mData + end + 4) != 0 || read16(mData + end + 8) != entryCount){
+        throw std::invalid_argument("Multi disk zip files are not supported: " + mPath);
+    }
+    if (entryCount == 0xffff || directoryOffset == 0xffffffff){
+        throw std::invalid_argument("Zip64 files are not supported: " + mPath);
+    }
+    checkRange(directoryOffset, directorySize);
+
+    mEntries.reserve(entryCount);
+    size_t pos = directoryOffset;
+    for (uint16_t i = 0; i < entryCount; i++){
+        checkRange(pos, CentralDirectoryEntrySize);
+        const uint8_t* p = mData + pos;
+        if (read32(p) != CentralDirectorySignature){
+            throw std::invalid_argument("Broken central directory in " + mPath);
+        }
+        uint16_t nameLength = read16(p + 28);
+        uint16_t extraLength = read16(p + 30);
+        uint16_t commentLength = read16(p + 32);
+        checkRange(pos + CentralDirectoryEntrySize, nameLength);
+        Entry entry;
+        entry.method = read16(p + 10);
+        entry.compressedSize = read32(p + 20);
+        entry.size = read32(p + 24);
+        entry.localHeaderOffset = read32(p + 42);
+        if (read16(p + 8) & 1){
+            // Encrypted, reported on lookup
+            entry.method = 0xffff;
+        }
+        // Like the JDK, the first entry of a name wins
+        mEntries.emplace(std::string(reinterpret_cast<const char*>(p + CentralDirectoryEntrySize), nameLength), entry);
+        pos += CentralDirectoryEntrySize + nameLength + extraLength + commentLength;
+    }
+}
+
+size_t JarFile::entryCount() const {
+    std::call_once(mOpened, [this] { open(); });
+    return mEntries.size();
+}
+
+ByteView JarFile::find(const std::string& name) const {
+    std::call_once(mOpened, [this] { open(); });
+    auto i = mEntries.find(name);
+    if (i == mEntries.end()){
+        return ByteView();
+    }
+    const Entry& entry = i->second;
+    checkRange(entry.localHeaderOffset, LocalHeaderSize);
+    const uint8_t* header = mData + entry.localHeaderOffset;
+    if (read32(header) != LocalHeaderSignature){
+        throw std::invalid_argument("Broken entry " + name + " in " + mPath);
+    }
+    // Sizes are taken from the central directory, the local ones may be in a trailing data descriptor
+    uint64_t dataOffset = entry.localHeaderOffset + LocalHeaderSize + read16(header + 26) + read16(header + 28);
+    checkRange(dataOffset, entry.compressedSize);
+    const uint8_t* data = mData + dataOffset;
+    switch (entry.method){
+        case Stored:
+            if (entry.compressedSize != entry.size){
+                throw std::invalid_argument("Broken entry " + name + " in " + mPath);
+            }
+            return ByteView(data, entry.size, shared_from_this());
+        case Deflated:
+            return inflate(entry, data);
+        default:
+            throw std::invalid_argument("Unsupported compression of " + name + " in " + mPath);
+    }
+}
+
+ByteView JarFile::inflate(const Entry& entry, const uint8_t* compressed) const {
+    ByteArrayPtr result = std::make_shared<ByteArray>(entry.size);
+    z_stream stream = z_stream();
+    // Raw deflate data, without zlib header
+    if (inflateInit2(&stream, -MAX_WBITS) != Z_OK){
+        throw std::invalid_argument("Could not initialize zlib");
+    }
+    stream.next_in = const_cast<Bytef*>(compressed);
+    stream.avail_in = entry.compressedSize;
+    stream.next_out = result->data();
+    stream.avail_out = entry.size;
+    int status = ::inflate(&stream, Z_FINISH);
+    inflateEnd(&stream);
+    if (status != Z_STREAM_END || stream.total_out != entry.size){
+        throw std::invalid_argument("Broken compressed entry in " + mPath);
+    }
+    return ByteView(result);
+}
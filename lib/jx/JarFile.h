@@ -0,0 +1,48 @@
+#pragma once
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <boost/noncopyable.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include "ByteView.h"
+
+/** Reads entries of a jar (zip) file. The file is memory mapped and its central directory is
+    indexed by name on the first lookup, so a lookup is one hash probe; stored entries are served
+    straight from the mapping, deflated ones are inflated into a new buffer.
+
+    Lookups are thread safe, the ClassPrefetcher workers share the jars of their ClassLoader.
+    Zip64, encrypted and multi disk archives are not supported. */
+class JarFile : public std::enable_shared_from_this<JarFile>, boost::noncopyable {
+public:
+    /** Throws std::invalid_argument if the file does not exist, it is opened on the first lookup
+        (classes may all come from a ClassArchive). */
+    explicit JarFile(const std::string& path);
+
+    const std::string& path() const { return mPath; }
+
+    /** Content of an entry (e.g. java/lang/Object.class), empty if there is none.
+        Throws std::invalid_argument if the jar or the entry is broken. */
+    ByteView find(const std::string& name) const;
+
+    /** Number of entries, opens the jar. */
+    size_t entryCount() const;
+
+private:
+    struct Entry {
+        uint16_t method;
+        uint32_t compressedSize;
+        uint32_t size;
+        uint32_t localHeaderOffset;
+    };
+
+    void open() const;
+    void checkRange(uint64_t offset, uint64_t length) const;
+    ByteView inflate(const Entry& entry, const uint8_t* compressed) const;
+
+    std::string mPath;
+    mutable std::once_flag mOpened;
+    mutable boost::iostreams::mapped_file_source mMappedFile;
+    mutable const uint8_t* mData = nullptr;
+    mutable size_t mSize = 0;
+    mutable std::unordered_map<std::string, Entry> mEntries;
+};
@@ -2,8 +2,14 @@
 #include <iostream>
 #include "assert.h"
 #include <sstream>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <vector>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/tss.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
 
 namespace logging {
 
@@ -11,13 +17,146 @@ static boost::mutex gGlobalLockMutex;
 static LogLevel gMinLogLevel = LL_INFO;
 static boost::thread_specific_ptr< std::string> gThreadName;
 
+namespace {
+
+/// Messages of one thread, pushed by it and popped by the writer without locking (single producer, single consumer)
+class LogRing {
+public:
+    static const size_t Capacity = 1024;
+
+    LogRing() : mHead(0), mTail(0) {}
+
+    bool push (std::string& message) {
+        size_t head = mHead.load (std::memory_order_relaxed);
+        if (head - mTail.load (std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        mEntries[head % Capacity].swap (message);
+        mHead.store (head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop (std::string& message) {
+        size_t tail = mTail.load (std::memory_order_relaxed);
+        if (tail == mHead.load (std::memory_order_acquire)) {
+            return false;
+        }
+        message.swap (mEntries[tail % Capacity]);
+        mTail.store (tail + 1, std::memory_order_release);
+        return true;
+    }
+private:
+    std::string mEntries[Capacity];
+    std::atomic<size_t> mHead;
+    std::atomic<size_t> mTail;
+};
+
+/// Per thread state, the ring itself is owned by the backend, so that it is written out after the thread ended
+struct ThreadLog {
+    std::ostringstream stream;
+    LogRing * ring = nullptr;
+};
+
+/// Writes the rings of all threads to std::cerr from a background thread
+class LogBackend {
+public:
+    static const int FlushIntervalMs = 20;
+
+    LogBackend () : mStop (false) {
+        mPreviousTerminate = std::set_terminate (&LogBackend::onTerminate);
+        mWriter = boost::thread ([this] { run(); });
+    }
+
+    ~LogBackend() {
+        {
+            boost::lock_guard<boost::mutex> lock (mWakeUpMutex);
+            mStop = true;
+        }
+        mWakeUp.notify_one();
+        mWriter.join();
+        flush();
+    }
+
+    static LogBackend & instance() {
+        static LogBackend backend;
+        return backend;
+    }
+
+    ThreadLog & threadLog() {
+        ThreadLog * log = mThreadLog.get();
+        if (!log) {
+            log = new ThreadLog();
+            mThreadLog.reset (log);
+            // Only once per thread
+            boost::lock_guard<boost::mutex> lock (mRingsMutex);
+            mRings.emplace_back (new LogRing());
+            log->ring = mRings.back().get();
+        }
+        return *log;
+    }
+
+    void push (LogRing & ring, std::string & message) {
+        while (!ring.push (message)) {
+            // Full, the writer is behind
+            mWakeUp.notify_one();
+            boost::this_thread::yield();
+        }
+    }
+
+    /// Writes out all queued messages, in order per thread
+    void flush() {
+        LogLockGuard guard;
+        std::vector<LogRing*> rings;
+        {
+            boost::lock_guard<boost::mutex> lock (mRingsMutex);
+            for (const auto & ring : mRings) {
+                rings.push_back (ring.get());
+            }
+        }
+        std::string message;
+        for (LogRing * ring : rings) {
+            while (ring->pop (message)) {
+                std::cerr << message << std::endl;
+            }
+        }
+    }
+private:
+    void run() {
+        boost::unique_lock<boost::mutex> lock (mWakeUpMutex);
+        while (!mStop) {
+            lock.unlock();
+            flush();
+            lock.lock();
+            if (!mStop) {
+                mWakeUp.timed_wait (lock, boost::posix_time::milliseconds (FlushIntervalMs));
+            }
+        }
+    }
+
+    static void onTerminate() {
+        // Don't lose the messages leading to an uncaught exception
+        instance().flush();
+        instance().mPreviousTerminate();
+    }
+
+    boost::thread_specific_ptr<ThreadLog> mThreadLog;
+    boost::mutex mRingsMutex;
+    std::vector<std::unique_ptr<LogRing>> mRings;
+
+    boost::mutex mWakeUpMutex;
+    boost::condition_variable mWakeUp;
+    bool mStop;
+    std::terminate_handler mPreviousTerminate;
+    boost::thread mWriter;
+};
+
+const int LogBackend::FlushIntervalMs;
 
-static std::ostream & logStream(LogLevel level) {
-    return std::cerr;
 }
 
 static const char * logLevelToString (LogLevel level) {
     switch (level) {
+        case LL_TRACE:  return  " Trace";
         case LL_DEBUG:  return  " Debug";
         case LL_INFO:   return  "  Info";
         case LL_NOTICE: return  "Notice";
@@ -30,7 +169,7 @@ static const char * logLevelToString (LogLevel level) {
 }
 
 static int countLogLevel (LogLevel level) {
-    static int count[LL_COUNT] = { 0 } ;
+    static std::atomic<int> count[LL_COUNT];
     return count[level]++;
 }
 
@@ -56,11 +195,24 @@ static const char * threadName() {
 }
 
 std::ostream & logStreamPreformat (const char * file, int line, LogLevel level) {
-    return logStream (level) << "[" << logLevelToString (level) << "]" << threadName() << " " << countLogLevel(level) <<  " " << myBaseName(file) << ":" << line <<  " ";
+    std::ostringstream & stream = LogBackend::instance().threadLog().stream;
+    stream.str (std::string());
+    return stream << "[" << logLevelToString (level) << "]" << threadName() << " " << countLogLevel(level) <<  " " << myBaseName(file) << ":" << line <<  " ";
 }
 
 void logExecLog (LogLevel level, std::ostream& stream) {
-    stream << std::endl;
+    LogBackend & backend = LogBackend::instance();
+    ThreadLog & log = backend.threadLog();
+    assert (&stream == &log.stream);
+    std::string message = log.stream.str();
+    backend.push (*log.ring, message);
+    if (level >= LL_ERROR) {
+        backend.flush();
+    }
+}
+
+void logFlush () {
+    LogBackend::instance().flush();
 }
 
 bool logIsRequested (const LogLevel level) {
@@ -7,15 +7,18 @@ namespace logging {
 // Note: logging copy and pasted from libpcore, https://github.com/nob13/pcore
 // Just threw out android support
 
-// Different log levels
-enum LogLevel { LL_DEBUG, LL_INFO, LL_NOTICE, LL_WARNING, LL_ERROR, LL_COUNT };
+// Different log levels, trace is for hot paths of the interpreter
+enum LogLevel { LL_TRACE, LL_DEBUG, LL_INFO, LL_NOTICE, LL_WARNING, LL_ERROR, LL_COUNT };
 
-/// Returns the logstream for a given file, line and log level
+/// Returns the (thread local) logstream for a given file, line and log level
 std::ostream & logStreamPreformat (const char * file, int line, LogLevel level);
 
-/// Executes a given Log
+/// Executes a given Log, the message is queued and written asynchronously (errors are written at once)
 void logExecLog (LogLevel logLevel, std::ostream&);
 
+/// Writes all queued messages
+void logFlush ();
+
 /// Log level is requested
 bool logIsRequested (const LogLevel level);
 
@@ -25,7 +28,7 @@ void logSetMinLockLevel (const LogLevel level);
 /// Set a log thread name for this thread, keep string valid
 void logSetThreadName(const std::string & threadName);
 
-/// RAII Structure locking the log
+/// RAII Structure locking the log output
 struct LogLockGuard {
     LogLockGuard ();
     ~LogLockGuard();
@@ -37,54 +40,68 @@ private:
 template <class A>
 void log (const char * file, int line, LogLevel level, const A&a) {
     if (!logIsRequested (level)) return;
-    LogLockGuard guard;
     logExecLog (level, logStreamPreformat (file, line, level) << a);
 }
 template <class A, class B>
 void log (const char * file, int line, LogLevel level, const A&a, const B&b) {
     if (!logIsRequested (level)) return;
-    LogLockGuard guard;
     logExecLog (level, logStreamPreformat (file, line, level) << a << " " << b);
 }
 template <class A, class B, class C>
 void log (const char * file, int line, LogLevel level, const A&a, const B&b, const C&c) {
     if (!logIsRequested (level)) return;
-    LogLockGuard guard;
     logExecLog (level, logStreamPreformat (file, line, level) << a << " " << b << " " << c);
 }
 template <class A, class B, class C, class D>
 void log (const char * file, int line, LogLevel level, const A&a, const B&b, const C&c, const D&d) {
     if (!logIsRequested (level)) return;
-    LogLockGuard guard;
     logExecLog (level, logStreamPreformat (file, line, level) << a << " " << b << " " << c  << " " << d);
 }
 template <class A, class B, class C, class D, class E>
 void log (const char * file, int line, LogLevel level, const A&a, const B&b, const C&c, const D&d, const E&e) {
     if (!logIsRequested (level)) return;
-    LogLockGuard guard;
     logExecLog (level, logStreamPreformat (file, line, level) << a << " " << b << " " << c  << " " << d << " " << e);
 }
 template <class A, class B, class C, class D, class E, class F>
 void log (const char * file, int line, LogLevel level, const A&a, const B&b, const C&c, const D&d, const E&e, const F&f) {
     if (!logIsRequested (level)) return;
-    LogLockGuard guard;
     logExecLog (level, logStreamPreformat (file, line, level) << a << " " << b << " " << c  << " " << d << " " << e << " " << f);
 }
 
 }
 
+// Minimum log level compiled in (0 = trace ... 5 = error), calls below it are compiled out
+#ifndef JX_LOG_MIN_LEVEL
+#define JX_LOG_MIN_LEVEL 2
+#endif
+
 // Variadic macros, Part of C99 and Supported by GCC and VS >= 2008
+#if JX_LOG_MIN_LEVEL <= 0
+#define logt(...) ::logging::log (__FILE__, __LINE__, ::logging::LL_TRACE, __VA_ARGS__)
+#else
+#define logt(...)
+#endif
+#if JX_LOG_MIN_LEVEL <= 1
 #define logd(...) ::logging::log (__FILE__, __LINE__, ::logging::LL_DEBUG, __VA_ARGS__)
+#else
+#define logd(...)
+#endif
+#if JX_LOG_MIN_LEVEL <= 2
 #define logi(...) ::logging::log (__FILE__, __LINE__, ::logging::LL_INFO, __VA_ARGS__)
+#else
+#define logi(...)
+#endif
+#if JX_LOG_MIN_LEVEL <= 3
 #define logn(...) ::logging::log (__FILE__, __LINE__, ::logging::LL_NOTICE, __VA_ARGS__)
+#else
+#define logn(...)
+#endif
+#if JX_LOG_MIN_LEVEL <= 4
 #define logw(...) ::logging::log (__FILE__, __LINE__, ::logging::LL_WARNING, __VA_ARGS__)
+#else
+#define logw(...)
+#endif
 #define loge(...) ::logging::log (__FILE__, __LINE__, ::logging::LL_ERROR, __VA_ARGS__)
 
 // Provide your own loglevel log_customlevel --> log_customlevel (loglevel, args)
 #define log_customlevel(...)::pc::log (__FILE__, __LINE__, __VA_ARGS__)
-
-
-// Disable logd, will be compiled out
-#undef logd
-// Disable logd
-#define logd(...)
@@ -3,7 +3,7 @@
 #include "StringUtils.h"
 #include "Log.h"
 
-static Variable doPrivilegedFake(const FunctionContext& context, const Variables& variables){
+static Variable doPrivilegedFake(const FunctionContext& context, const LocalArray& variables){
     assert(variables.size() == 1);
     Variable privilegedAction = variables.variables[0];
     assert(privilegedAction.type == ObjectRef);
@@ -17,7 +17,8 @@ static Variable doPrivilegedFake(const FunctionContext& context, const Variables
 }
 
 void MethodOverrides::addDefaultOverrides(){
-    add("java/lang/Double", "longBitsToDouble", "(J)D", [](const FunctionContext&, const Variables& variables){
+    addStringIntrinsics();
+    add("java/lang/Double", "longBitsToDouble", "(J)D", [](const FunctionContext&, const LocalArray& variables){
         assert (variables.size() == 1);
         const Variable & arg0 = variables.variables[0];
         assert (arg0.type == Long);
@@ -26,17 +27,16 @@ void MethodOverrides::addDefaultOverrides(){
         result.value.dv = d;
         return result;
     });
-    add("java/lang/Object", "hashCode", "()I", [](const FunctionContext&, const Variables& variables){
+    add("java/lang/Object", "hashCode", "()I", [](const FunctionContext&, const LocalArray& variables){
         assert (variables.size() == 1);
         auto thisp = variables.variables[0].value.object;
         return Variable(reinterpret_cast<int32_t&>(thisp));
     });
-    add("java/lang/String", "intern", "()Ljava/lang/String;", [](const FunctionContext&, const Variables& variables){
+    add("java/lang/String", "intern", "()Ljava/lang/String;", [](const FunctionContext& context, const LocalArray& variables){
         assert (variables.size() == 1);
-        logw("Fake implementation of String.intern!!");
-        return variables.variables[0];
+        return context.interpreter->intern(variables.variables[0]);
     });
-    add("java/lang/System", "arraycopy", "(Ljava/lang/Object;ILjava/lang/Object;II)V", [](const FunctionContext& context, const Variables& variables){
+    add("java/lang/System", "arraycopy", "(Ljava/lang/Object;ILjava/lang/Object;II)V", [](const FunctionContext& context, const LocalArray& variables){
         assert (variables.size() == 5);
         Variable src = variables.variables[0];
         Variable srcPos = variables.variables[1];
@@ -48,20 +48,18 @@ void MethodOverrides::addDefaultOverrides(){
         assert(srcPos.isStoredAsInteger());
         assert(targetPos.isStoredAsInteger());
         assert(length.isStoredAsInteger());
-        assert(targetPos.value.iv + length.value.iv <= target.value.object->array->length);
-        assert(srcPos.value.iv + length.value.iv <= src.value.object->array->length);
-        for (int32_t i = 0; i < length.value.iv; i++){
-            target.value.object->array->values[targetPos.value.iv + i] =src.value.object->array->values[srcPos.value.iv + i];
-        }
+        Array::copy(*src.array(), srcPos.value.iv, *target.array(), targetPos.value.iv, length.value.iv);
         return Variable();
     });
-    add("java/lang/System", "initProperties", "(Ljava/util/Properties;)Ljava/util/Properties;", [](const FunctionContext& context, const Variables& variables){
+    add("java/lang/System", "initProperties", "(Ljava/util/Properties;)Ljava/util/Properties;", [](const FunctionContext& context, const LocalArray& variables){
         assert (variables.size() == 1);
-        return context.interpreter->callStatic("jx/system/System", "initSystemProperties", variables);
+        Variables arguments;
+        arguments.push(variables.variables[0]);
+        return context.interpreter->callStatic("jx/system/System", "initSystemProperties", arguments);
     });
 
 
-    add("sun/reflect/Reflection", "getCallerClass", "()Ljava/lang/Class;", [](const FunctionContext& context, const Variables& variables){
+    add("sun/reflect/Reflection", "getCallerClass", "()Ljava/lang/Class;", [](const FunctionContext& context, const LocalArray& variables){
         assert(variables.size() == 0);
         // TODO: Name
         auto classClassFile = context.loader->loadByName("java/lang/Class");
@@ -70,32 +68,32 @@ void MethodOverrides::addDefaultOverrides(){
     });
     add("java/security/AccessController", "doPrivileged", "(Ljava/security/PrivilegedAction;)Ljava/lang/Object;", doPrivilegedFake);
     add("java/security/AccessController", "doPrivileged", "(Ljava/security/PrivilegedExceptionAction;)Ljava/lang/Object;", doPrivilegedFake);
-    add("java/lang/Thread", "currentThread", "()Ljava/lang/Thread;", [](const FunctionContext& context, const Variables& variables){
+    add("java/lang/Thread", "currentThread", "()Ljava/lang/Thread;", [](const FunctionContext& context, const LocalArray& variables){
         assert(variables.size() == 0);
         return context.interpreter->mainThread();
     });
     // hack (Ljava/lang/Class;Ljava/lang/Class;Ljava/lang/String;)Ljava/util/concurrent/atomic/AtomicReferenceFieldUpdater; jx/util/concurrent/atomic/AtomicReferenceFieldUpdater newUpdater
-    add("java/util/concurrent/atomic/AtomicReferenceFieldUpdater", "newUpdater", "(Ljava/lang/Class;Ljava/lang/Class;Ljava/lang/String;)Ljava/util/concurrent/atomic/AtomicReferenceFieldUpdater;",[](const FunctionContext& context, const Variables& variables){
+    add("java/util/concurrent/atomic/AtomicReferenceFieldUpdater", "newUpdater", "(Ljava/lang/Class;Ljava/lang/Class;Ljava/lang/String;)Ljava/util/concurrent/atomic/AtomicReferenceFieldUpdater;",[](const FunctionContext& context, const LocalArray& variables){
         assert(variables.size() == 3);
         Variable result(ObjectRef);
         // implementation can't work in the moment due missing reflection
         return result;
     });
     // disabling extended charsets, otherwise it crashes because there is no support for newInstance()
-    add("java/nio/charset/Charset$ExtendedProviderHolder", "extendedProvider", "()Ljava/nio/charset/spi/CharsetProvider;", [](const FunctionContext& context, const Variables& variables) {
+    add("java/nio/charset/Charset$ExtendedProviderHolder", "extendedProvider", "()Ljava/nio/charset/spi/CharsetProvider;", [](const FunctionContext& context, const LocalArray& variables) {
         // Returning nullptr, no additonal Charsets available
         assert(variables.size() == 0);
         Variable result(ObjectRef);
         return result;
     });
-    add("java/lang/Float", "floatToRawIntBits", "(F)I", [](const FunctionContext& context, const Variables& variables) {
+    add("java/lang/Float", "floatToRawIntBits", "(F)I", [](const FunctionContext& context, const LocalArray& variables) {
         // Returning nullptr, no additonal Charsets available
         assert(variables.size() == 1);
         auto f = variables.variables[0];
         assert(f.type == Float);
         return Variable(reinterpret_cast<int32_t&> (f.value.fv));
     });
-    add("java/lang/Double", "doubleToRawLongBits", "(D)J", [](const FunctionContext& context, const Variables& variables) {
+    add("java/lang/Double", "doubleToRawLongBits", "(D)J", [](const FunctionContext& context, const LocalArray& variables) {
         // Returning nullptr, no additonal Charsets available
         assert(variables.size() == 1);
         auto f = variables.variables[0];
@@ -104,15 +102,15 @@ void MethodOverrides::addDefaultOverrides(){
         result.value.lv = reinterpret_cast<int64_t&> (f.value.fv);
         return result;
     });
-    add("java/lang/Object", "getClass", "()Ljava/lang/Class;", [](const FunctionContext& context, const Variables& variables) {
+    add("java/lang/Object", "getClass", "()Ljava/lang/Class;", [](const FunctionContext& context, const LocalArray& variables) {
         // Returning nullptr, no additonal Charsets available
         assert(variables.size() == 1);
-        auto thisObject = variables.top();
+        auto thisObject = variables.variables[0];
 
         return context.interpreter->classByName(thisObject.value.object->type->name());
     });
 
-    add("java/lang/Class", "forName", "(Ljava/lang/String;ZLjava/lang/ClassLoader;)Ljava/lang/Class;", [](const FunctionContext& context, const Variables& variables) {
+    add("java/lang/Class", "forName", "(Ljava/lang/String;ZLjava/lang/ClassLoader;)Ljava/lang/Class;", [](const FunctionContext& context, const LocalArray& variables) {
         assert(variables.size() == 3);
         std::string className = stringutils::dotToSlashNotatation(variables.variables[0].stringValue());
 
@@ -120,24 +118,25 @@ void MethodOverrides::addDefaultOverrides(){
         bool initialize = variables.variables[1].value.iv != 0;
         return context.interpreter->classByName(className);
     });
-    add("java/lang/Class", "newInstance", "()Ljava/lang/Object;", [](const FunctionContext& context, const Variables& variables) {
+    add("java/lang/Class", "newInstance", "()Ljava/lang/Object;", [](const FunctionContext& context, const LocalArray& variables) {
         assert(variables.size() == 1); // this pointer
         auto thisObject = variables.variables[0];
         assert(thisObject.type == ObjectRef);
         assert(thisObject.value.object->type->name() == "java/lang/Class");
 
-        auto myClassNameVariable = thisObject.value.object->fields.find("__name");
-        if (myClassNameVariable == thisObject.value.object->fields.end()){
+        Variable * myClassNameVariable = thisObject.value.object->publicField("__name");
+        if (myClassNameVariable == nullptr || myClassNameVariable->value.object == nullptr){
             throw std::invalid_argument("Class object is not correctly initialized");
         }
-        std::string className = myClassNameVariable->second.stringValue();
+        std::string className = myClassNameVariable->stringValue();
 
         ClassFilePtr classFile = context.loader->loadByName(className);
         Variable instance = context.memory->allocateObject(classFile);
 
         MethodIdentifier methodIdentifier;
-        methodIdentifier.descriptor = "()V";
-        methodIdentifier.methodName = "<init>";
+        methodIdentifier.className = classFile->nameSymbol();
+        methodIdentifier.descriptor = Symbol::intern("()V");
+        methodIdentifier.methodName = Symbol::intern("<init>");
 
         auto initMethod = classFile->methodWithSignature(methodIdentifier);
         assert((bool)(initMethod));
@@ -147,39 +146,39 @@ void MethodOverrides::addDefaultOverrides(){
         context.interpreter->executeMethod(*classFile, *initMethod, *context.previousFrame, initArguments);
         return instance;
     });
-    add("java/nio/Bits", "byteOrder", "()Ljava/nio/ByteOrder;", [](const FunctionContext& context, const Variables& variables) {
+    add("java/nio/Bits", "byteOrder", "()Ljava/nio/ByteOrder;", [](const FunctionContext& context, const LocalArray& variables) {
         assert (variables.size() == 0);
         auto byteOrderClass = context.interpreter->findInitializedClass("java/nio/ByteOrder");
         GlobalVariableIdentifier id;
-        id.className = byteOrderClass->name();
-        id.name = "LITTLE_ENDIAN";
+        id.className = byteOrderClass->nameSymbol();
+        id.name = Symbol::intern("LITTLE_ENDIAN");
         Variable littleEndian = context.memory->getGlobal(id);
         return littleEndian;
     });
-    add("java/nio/Bits", "<clinit>", "()V", [](const FunctionContext& context, const Variables& variables) {
+    add("java/nio/Bits", "<clinit>", "()V", [](const FunctionContext& context, const LocalArray& variables) {
         assert (variables.size() == 0);
         // does calls to sun.misc.Unsafe which we do not support.
         return Variable();
     });
 
-    add("java/lang/System", "loadLibrary", "(Ljava/lang/String;)V", [](const FunctionContext& context, const Variables& variables) {
+    add("java/lang/System", "loadLibrary", "(Ljava/lang/String;)V", [](const FunctionContext& context, const LocalArray& variables) {
         assert(variables.size() == 1);
         std::string libName = variables.variables[0].stringValue();
         logi("Skipping loading of library ", libName);
         return Variable();
     });
-    add("java/lang/System", "setOut0", "(Ljava/io/PrintStream;)V", [](const FunctionContext& context, const Variables& variables) {
+    add("java/lang/System", "setOut0", "(Ljava/io/PrintStream;)V", [](const FunctionContext& context, const LocalArray& variables) {
         assert(variables.size() == 1);
         Variable printStream = variables.variables[0];
         assert (printStream.type == ObjectRef);
         assert (printStream.value.object->type->name() == "java/io/PrintStream");
         GlobalVariableIdentifier id;
-        id.className = "java/lang/System";
-        id.name = "out";
+        id.className = Symbol::intern("java/lang/System");
+        id.name = Symbol::intern("out");
         context.memory->putGlobal(id, printStream);
         return Variable();
     });
-    add("java/io/FileOutputStream", "writeBytes", "([BIIZ)V", [](const FunctionContext& context, const Variables& variables) {
+    add("java/io/FileOutputStream", "writeBytes", "([BIIZ)V", [](const FunctionContext& context, const LocalArray& variables) {
         assert(variables.size() == 5);
         Variable thisPointer = variables.variables[0];
         assert (thisPointer.type == ObjectRef);
@@ -203,14 +202,12 @@ void MethodOverrides::addDefaultOverrides(){
         int cFd = realFd.value.iv;
 
         // ignore append
-        for (int i = 0; i < length.value.iv; i++){
-            int8_t byte = (int8_t) byteArray.array()->values[i + offset.value.iv].iv;
-            write(cFd, &byte, 1);
-        }
+        assert(offset.value.iv >= 0 && length.value.iv >= 0 && (int64_t) offset.value.iv + length.value.iv <= (int64_t) byteArray.array()->length);
+        write(cFd, byteArray.array()->data<int8_t>() + offset.value.iv, length.value.iv);
 
         return Variable();
     });
-    add("java/lang/Class", "desiredAssertionStatus", "()Z", [](const FunctionContext& context, const Variables& variables) {
+    add("java/lang/Class", "desiredAssertionStatus", "()Z", [](const FunctionContext& context, const LocalArray& variables) {
         assert(variables.size() == 1);
         Variable result (Integer);
         result.value.iv = 1;
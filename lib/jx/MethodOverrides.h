@@ -1,13 +1,14 @@
 #include "Interpreter.h"
 #include <functional>
+#include <type_traits>
 
 struct MethodOverrideIdentifier {
-    std::string className;
-    std::string methodName;
-    std::string description;
+    const Symbol* className = nullptr;
+    const Symbol* methodName = nullptr;
+    const Symbol* description = nullptr;
 
     std::size_t hash() const {
-        return hash::combineHash(hash::combineHash(hash::stringHash(className), hash::stringHash(methodName)), hash::stringHash(description));
+        return hash::combineHash(hash::combineHash(className->hash(), methodName->hash()), description->hash());
     }
 };
 
@@ -22,25 +23,52 @@ struct FunctionContext {
     const Frame * previousFrame;
 };
 
+/** C++ replacement of a Java method. */
+struct MethodOverride {
+    typedef Variable (*Function)(const FunctionContext& context, const LocalArray&);
+    typedef std::function<Variable (const FunctionContext& context, const LocalArray&)> Closure;
+
+    /** Called directly if set. */
+    Function function = nullptr;
+    /** For overrides with state, only used if there is no function. */
+    Closure closure;
+
+    Variable call(const FunctionContext& context, const LocalArray& variables) const {
+        return function ? function(context, variables) : closure(context, variables);
+    }
+};
+
+/** Method overrides by class, name and descriptor. They are resolved once per method when it is prepared by the Interpreter. */
 class MethodOverrides {
 public:
-    typedef std::function<Variable (const FunctionContext& context, const Variables&)> FunctionOverride;
-    void add(const MethodOverrideIdentifier& id, const FunctionOverride& override){
-        mOverrides[id] = override;
+    void add(const MethodOverrideIdentifier& id, MethodOverride::Function function){
+        mOverrides[id].function = function;
+    }
+    void add(const MethodOverrideIdentifier& id, const MethodOverride::Closure& closure){
+        MethodOverride& override = mOverrides[id];
+        override.function = nullptr;
+        override.closure = closure;
     }
-    void add(const std::string& className, const std::string& methodName, const std::string& description, const FunctionOverride& override){
+    /** Adds a function, a lambda without captures is stored as plain function pointer. */
+    template <typename Callable>
+    void add(const std::string& className, const std::string& methodName, const std::string& description, const Callable& callable){
         MethodOverrideIdentifier id;
-        id.className = className;
-        id.methodName = methodName;
-        id.description = description;
-        add(id, override);
+        id.className = Symbol::intern(className);
+        id.methodName = Symbol::intern(methodName);
+        id.description = Symbol::intern(description);
+        typedef typename std::conditional<std::is_convertible<Callable, MethodOverride::Function>::value, MethodOverride::Function, MethodOverride::Closure>::type Target;
+        add(id, (Target) callable);
     }
-    FunctionOverride find(const MethodOverrideIdentifier& id) const {
+    /** Returns the override for a method, it stays valid for the lifetime of this object, nullptr if there is none. */
+    const MethodOverride* find(const MethodOverrideIdentifier& id) const {
         auto it = mOverrides.find(id);
-        return it == mOverrides.end() ? FunctionOverride() : it->second;
+        return it == mOverrides.end() ? nullptr : &it->second;
     }
 
     void addDefaultOverrides();
+    /** Native versions of hot String and StringBuilder methods, see StringIntrinsics.cpp. */
+    void addStringIntrinsics();
 private:
-    std::unordered_map<MethodOverrideIdentifier, FunctionOverride, hash::MethodHash<MethodOverrideIdentifier>> mOverrides;
-};
\ No newline at end of file
+    // Elements of unordered_map are never moved, so PreparedMethods can point to them
+    std::unordered_map<MethodOverrideIdentifier, MethodOverride, hash::MethodHash<MethodOverrideIdentifier>> mOverrides;
+};
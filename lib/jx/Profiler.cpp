@@ -0,0 +1,218 @@
+#include "Profiler.h"
+#include "Interpreter.h"
+#include "ClassFile.h"
+#include "Ops.h"
+#include <algorithm>
+#include <iomanip>
+
+namespace {
+
+void writeJsonString(std::ostream& out, const std::string& value) {
+    out << '"';
+    for (char c : value){
+        switch (c){
+            case '"':  out << "\\\""; break;
+            case '\\': out << "\\\\"; break;
+            case '\n': out << "\\n"; break;
+            default:
+                if ((unsigned char) c < 0x20){
+                    out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int) c << std::dec << std::setfill(' ');
+                } else {
+                    out << c;
+                }
+        }
+    }
+    out << '"';
+}
+
+}
+
+Profiler::Profiler() : mCurrent(nullptr) {
+}
+
+Profiler::~Profiler() {
+    stopSampling();
+}
+
+void Profiler::enterMethod(const PreparedMethod& prepared) {
+    MethodEntry& entry = mMethods[&prepared];
+    MethodProfile& profile = entry.profile;
+    if (profile.invocations == 0){
+        profile.className = prepared.clazz ? prepared.clazz->name() : std::string();
+        profile.methodName = prepared.methodName ? prepared.methodName->str() : std::string();
+        profile.descriptor = prepared.descriptorSymbol ? prepared.descriptorSymbol->str() : std::string();
+    }
+    profile.invocations++;
+    entry.activeCalls++;
+    ActiveCall call { &entry, mInstructions, 0 };
+    mCalls.push_back(call);
+    mCurrent.store(&entry, std::memory_order_release);
+}
+
+void Profiler::leaveMethod() {
+    assert(!mCalls.empty());
+    ActiveCall call = mCalls.back();
+    mCalls.pop_back();
+    uint64_t inclusive = mInstructions - call.startInstructions;
+    MethodEntry& entry = *call.entry;
+    entry.profile.exclusiveInstructions += inclusive - call.calleeInstructions;
+    entry.activeCalls--;
+    if (entry.activeCalls == 0){
+        entry.profile.inclusiveInstructions += inclusive;
+    }
+    if (mCalls.empty()){
+        mCurrent.store(nullptr, std::memory_order_release);
+    } else {
+        mCalls.back().calleeInstructions += inclusive;
+        mCurrent.store(mCalls.back().entry, std::memory_order_release);
+    }
+}
+
+void Profiler::receiver(uint32_t pc, const Variable& thisPointer) {
+    if (mCalls.empty()){
+        return;
+    }
+    const Object* object = thisPointer.type == ObjectRef ? thisPointer.value.object : nullptr;
+    static const std::string nullReceiver = "null";
+    static const std::string arrayReceiver = "<array>";
+    const std::string& name = !object ? nullReceiver : (object->type ? object->type->name() : arrayReceiver);
+    mCalls.back().entry->profile.receivers[pc][name]++;
+}
+
+void Profiler::startSampling(int intervalMicros) {
+    stopSampling();
+    mSampleIntervalMicros = intervalMicros;
+    mSampling = true;
+    mSampler = boost::thread([this] { sample(); });
+}
+
+void Profiler::stopSampling() {
+    {
+        boost::lock_guard<boost::mutex> lock (mSamplerMutex);
+        if (!mSampling){
+            return;
+        }
+        mSampling = false;
+    }
+    mSamplerWakeUp.notify_one();
+    mSampler.join();
+    for (const auto& sample : mSamples){
+        sample.first->profile.samples += sample.second;
+    }
+    mSamples.clear();
+}
+
+void Profiler::sample() {
+    boost::unique_lock<boost::mutex> lock (mSamplerMutex);
+    while (mSampling){
+        mSamplerWakeUp.timed_wait(lock, boost::posix_time::microseconds(mSampleIntervalMicros));
+        if (!mSampling){
+            break;
+        }
+        MethodEntry* current = mCurrent.load(std::memory_order_acquire);
+        if (current){
+            mSamples[current]++;
+            mSampleCount++;
+        }
+    }
+}
+
+std::vector<MethodProfile> Profiler::methods() const {
+    std::vector<MethodProfile> result;
+    result.reserve(mMethods.size());
+    for (const auto& method : mMethods){
+        result.push_back(method.second.profile);
+    }
+    std::sort(result.begin(), result.end(), [](const MethodProfile& a, const MethodProfile& b) {
+        if (a.exclusiveInstructions != b.exclusiveInstructions){
+            return a.exclusiveInstructions > b.exclusiveInstructions;
+        }
+        return a.invocations > b.invocations;
+    });
+    return result;
+}
+
+void Profiler::writeReport(std::ostream& out, size_t maxMethods) const {
+    std::vector<MethodProfile> profiles = methods();
+    out << "Profile: " << mInstructions << " instructions, " << profiles.size() << " methods, "
+        << mSampleCount << " samples every " << mSampleIntervalMicros << "us" << std::endl;
+
+    out << std::endl << "Methods by exclusive instructions:" << std::endl;
+    out << std::setw(14) << "exclusive" << std::setw(14) << "inclusive" << std::setw(12) << "calls"
+        << std::setw(10) << "samples" << "  method" << std::endl;
+    for (size_t i = 0; i < profiles.size() && i < maxMethods; i++){
+        const MethodProfile& p = profiles[i];
+        out << std::setw(14) << p.exclusiveInstructions << std::setw(14) << p.inclusiveInstructions << std::setw(12) << p.invocations
+            << std::setw(10) << p.samples << "  " << p.className << "." << p.methodName << p.descriptor << std::endl;
+    }
+
+    std::vector<std::pair<uint64_t, int>> opcodes;
+    for (int op = 0; op < 256; op++){
+        if (mOpcodeCounts[op]){
+            opcodes.push_back(std::make_pair(mOpcodeCounts[op], op));
+        }
+    }
+    std::sort(opcodes.rbegin(), opcodes.rend());
+    out << std::endl << "Opcodes:" << std::endl;
+    for (const auto& opcode : opcodes){
+        double share = mInstructions ? 100.0 * opcode.first / mInstructions : 0.0;
+        out << std::setw(14) << opcode.first << std::setw(7) << std::fixed << std::setprecision(2) << share << "%  " << ops::opToStr(opcode.second) << std::endl;
+    }
+
+    out << std::endl << "Virtual call sites:" << std::endl;
+    for (size_t i = 0; i < profiles.size() && i < maxMethods; i++){
+        const MethodProfile& p = profiles[i];
+        for (const auto& site : p.receivers){
+            out << "  " << p.className << "." << p.methodName << "@" << site.first << ":";
+            for (const auto& receiver : site.second){
+                out << " " << receiver.first << "=" << receiver.second;
+            }
+            out << std::endl;
+        }
+    }
+}
+
+void Profiler::writeJson(std::ostream& out) const {
+    std::vector<MethodProfile> profiles = methods();
+    out << "{\"instructions\":" << mInstructions
+        << ",\"samples\":" << mSampleCount
+        << ",\"sampleIntervalMicros\":" << mSampleIntervalMicros
+        << ",\"opcodes\":{";
+    bool first = true;
+    for (int op = 0; op < 256; op++){
+        if (mOpcodeCounts[op]){
+            out << (first ? "" : ",") << "\"" << ops::opToStr(op) << "\":" << mOpcodeCounts[op];
+            first = false;
+        }
+    }
+    out << "},\"methods\":[";
+    for (size_t i = 0; i < profiles.size(); i++){
+        const MethodProfile& p = profiles[i];
+        out << (i ? "," : "") << "{\"class\":";
+        writeJsonString(out, p.className);
+        out << ",\"method\":";
+        writeJsonString(out, p.methodName);
+        out << ",\"descriptor\":";
+        writeJsonString(out, p.descriptor);
+        out << ",\"invocations\":" << p.invocations
+            << ",\"inclusiveInstructions\":" << p.inclusiveInstructions
+            << ",\"exclusiveInstructions\":" << p.exclusiveInstructions
+            << ",\"samples\":" << p.samples
+            << ",\"callSites\":[";
+        bool firstSite = true;
+        for (const auto& site : p.receivers){
+            out << (firstSite ? "" : ",") << "{\"pc\":" << site.first << ",\"receivers\":{";
+            bool firstReceiver = true;
+            for (const auto& receiver : site.second){
+                out << (firstReceiver ? "" : ",");
+                writeJsonString(out, receiver.first);
+                out << ":" << receiver.second;
+                firstReceiver = false;
+            }
+            out << "}}";
+            firstSite = false;
+        }
+        out << "]}";
+    }
+    out << "]}" << std::endl;
+}
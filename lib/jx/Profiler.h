@@ -0,0 +1,103 @@
+#pragma once
+#include <atomic>
+#include <map>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include "types.h"
+
+struct PreparedMethod;
+struct Variable;
+
+/** Counters of a single method, see Profiler::methods. */
+struct MethodProfile {
+    std::string className;
+    std::string methodName;
+    std::string descriptor;
+
+    uint64_t invocations = 0;
+    /** Instructions executed by the method and its callees, recursive calls are counted once. */
+    uint64_t inclusiveInstructions = 0;
+    /** Instructions executed by the method itself. */
+    uint64_t exclusiveInstructions = 0;
+    /** Wall clock samples which found the method executing (innermost). */
+    uint64_t samples = 0;
+    /** Receiver classes by byte code offset of the invokevirtual/invokeinterface. */
+    std::map<uint32_t, std::map<std::string, uint64_t>> receivers;
+};
+
+/** Opt-in bytecode profiler, see Interpreter::setProfiler.
+    Counts opcodes, invocations, inclusive/exclusive instructions and receivers of virtual call sites;
+    optionally samples the executing method from a background thread.
+    Instructions are only counted by the switch engine, so the interpreter uses it while profiling. */
+class Profiler {
+public:
+    static const int DefaultSampleIntervalMicros = 1000;
+
+    Profiler();
+    ~Profiler();
+
+    // Callbacks of the interpreter, all from the interpreting thread
+    void enterMethod(const PreparedMethod& prepared);
+    void leaveMethod();
+    void instruction(uint8_t op) {
+        mOpcodeCounts[op]++;
+        mInstructions++;
+    }
+    /** Records the receiver of a virtual call at pc of the current method. */
+    void receiver(uint32_t pc, const Variable& thisPointer);
+
+    /** Starts sampling the executing method every intervalMicros of wall clock time. */
+    void startSampling(int intervalMicros = DefaultSampleIntervalMicros);
+    /** Stops sampling, samples are added to the method profiles when sampling stops. */
+    void stopSampling();
+
+    uint64_t instructions() const { return mInstructions; }
+    uint64_t opcodeCount(uint8_t op) const { return mOpcodeCounts[op]; }
+    uint64_t sampleCount() const { return mSampleCount; }
+
+    /** Profiles of all entered methods, most exclusive instructions first. */
+    std::vector<MethodProfile> methods() const;
+
+    /** Human readable report, limited to the top maxMethods methods. */
+    void writeReport(std::ostream& out, size_t maxMethods = 30) const;
+    /** Machine readable report with all methods. */
+    void writeJson(std::ostream& out) const;
+
+private:
+    Profiler(const Profiler&);
+    Profiler& operator=(const Profiler&);
+
+    struct MethodEntry {
+        MethodProfile profile;
+        /** Calls currently on the stack, for counting recursive calls inclusive once. */
+        uint32_t activeCalls = 0;
+    };
+    struct ActiveCall {
+        MethodEntry* entry;
+        uint64_t startInstructions;
+        uint64_t calleeInstructions;
+    };
+
+    void sample();
+
+    std::unordered_map<const PreparedMethod*, MethodEntry> mMethods;
+    std::vector<ActiveCall> mCalls;
+    uint64_t mOpcodeCounts[256] = {};
+    uint64_t mInstructions = 0;
+
+    /** Innermost method, read by the sampling thread. */
+    std::atomic<MethodEntry*> mCurrent;
+    /** Owned by the sampling thread until it is stopped. */
+    std::unordered_map<MethodEntry*, uint64_t> mSamples;
+    uint64_t mSampleCount = 0;
+    int mSampleIntervalMicros = 0;
+    bool mSampling = false;
+    boost::mutex mSamplerMutex;
+    boost::condition_variable mSamplerWakeUp;
+    boost::thread mSampler;
+};
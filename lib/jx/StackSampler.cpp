@@ -0,0 +1,86 @@
+#include "StackSampler.h"
+#include "Interpreter.h"
+#include "ClassFile.h"
+#include <algorithm>
+
+namespace {
+
+void writeFrame(std::ostream& out, const PreparedMethod& method) {
+    if (method.clazz){
+        std::string className = method.clazz->name();
+        std::replace(className.begin(), className.end(), '/', '.');
+        out << className;
+    }
+    if (method.methodName){
+        out << "::" << *method.methodName;
+    }
+}
+
+}
+
+StackSampler::StackSampler() : mDue(false) {
+}
+
+StackSampler::~StackSampler() {
+    stop();
+}
+
+void StackSampler::start(int intervalMicros) {
+    stop();
+    mIntervalMicros = intervalMicros;
+    mRunning = true;
+    mTimer = boost::thread([this] { run(); });
+}
+
+void StackSampler::stop() {
+    {
+        boost::lock_guard<boost::mutex> lock (mTimerMutex);
+        if (!mRunning){
+            return;
+        }
+        mRunning = false;
+    }
+    mTimerWakeUp.notify_one();
+    mTimer.join();
+    mDue.store(false, std::memory_order_relaxed);
+}
+
+void StackSampler::run() {
+    boost::unique_lock<boost::mutex> lock (mTimerMutex);
+    while (mRunning){
+        mTimerWakeUp.timed_wait(lock, boost::posix_time::microseconds(mIntervalMicros));
+        if (mRunning){
+            requestSample();
+        }
+    }
+}
+
+void StackSampler::takeSample(const Frame* top) {
+    mDue.store(false, std::memory_order_relaxed);
+    mScratch.clear();
+    for (const Frame* frame = top; frame; frame = frame->caller){
+        // Frames of C++ callers have no method
+        if (frame->method){
+            mScratch.push_back(frame->method);
+        }
+    }
+    if (mScratch.empty()){
+        return;
+    }
+    mStacks[mScratch]++;
+    mSampleCount++;
+}
+
+void StackSampler::writeFolded(std::ostream& out) const {
+    for (const auto& stack : mStacks){
+        const std::vector<const PreparedMethod*>& methods = stack.first;
+        for (auto it = methods.rbegin(); it != methods.rend(); ++it){
+            if (it != methods.rbegin()){
+                out << ";";
+            }
+            writeFrame(out, **it);
+        }
+        out << " " << stack.second << "\n";
+    }
+    out.flush();
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <atomic>
+#include <map>
+#include <ostream>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include "types.h"
+
+struct Frame;
+struct PreparedMethod;
+
+/** Sampling profiler of the Java stack, written as folded stacks for flame graphs
+    (see https://github.com/brendangregg/FlameGraph).
+
+    A timer thread marks a sample as due every interval; the interpreter takes it at its next poll
+    (method entry, taken branches, each instruction of the switch engine) by walking the frame chain,
+    see Interpreter::setStackSampler. Without a due sample a poll is a single relaxed load. */
+class StackSampler : public boost::noncopyable {
+public:
+    static const int DefaultIntervalMicros = 10000;
+
+    StackSampler();
+    ~StackSampler();
+
+    /** Starts the timer thread, marking a sample as due every intervalMicros of wall clock time. */
+    void start(int intervalMicros = DefaultIntervalMicros);
+    void stop();
+
+    bool sampleDue() const { return mDue.load(std::memory_order_relaxed); }
+    /** Marks a sample as due, normally done by the timer thread. */
+    void requestSample() { mDue.store(true, std::memory_order_relaxed); }
+
+    /** Records the stack from the given top frame down to the first one, from the interpreting thread. */
+    void takeSample(const Frame* top);
+
+    uint64_t sampleCount() const { return mSampleCount; }
+
+    /** Writes one line per distinct stack, "Class::method" frames from the outermost separated by ';'
+        followed by the sample count. Methods are owned by the interpreter, which must still be alive. */
+    void writeFolded(std::ostream& out) const;
+
+private:
+    void run();
+
+    std::atomic<bool> mDue;
+    /** Sample counts by stack, innermost method first. */
+    std::map<std::vector<const PreparedMethod*>, uint64_t> mStacks;
+    std::vector<const PreparedMethod*> mScratch;
+    uint64_t mSampleCount = 0;
+
+    int mIntervalMicros = 0;
+    bool mRunning = false;
+    boost::mutex mTimerMutex;
+    boost::condition_variable mTimerWakeUp;
+    boost::thread mTimer;
+};
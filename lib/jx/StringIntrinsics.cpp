@@ -0,0 +1,221 @@
+#include "MethodOverrides.h"
+#include "Variable.h"
+#include <algorithm>
+#include <cstring>
+
+// Native implementations of hot java.lang.String / StringBuilder methods (JDK 8 layout).
+// They work directly on the char[] behind the objects and must behave exactly like the bytecode.
+
+namespace {
+
+/** Slot of an instance field, looked up again only if the class of the object changes. */
+class FieldSlot {
+public:
+    explicit FieldSlot(const std::string& key) : mKey(key) {}
+
+    Variable& in(Object* object) {
+        if (object->type.get() != mType){
+            int slot = object->type->instanceFieldSlot(mKey);
+            if (slot < 0){
+                throw std::invalid_argument("Field " + mKey + " not found in " + object->type->name());
+            }
+            mType = object->type.get();
+            mSlot = (size_t) slot;
+        }
+        return object->fields[mSlot];
+    }
+private:
+    std::string mKey;
+    const ClassFile* mType = nullptr;
+    size_t mSlot = 0;
+};
+
+/** Fields used by the intrinsics, shared by all of them. */
+struct StringFields {
+    FieldSlot value { "java/lang/String__value" };
+    FieldSlot hash { "java/lang/String__hash" };
+    FieldSlot builderValue { "value" };
+    FieldSlot builderCount { "count" };
+
+    Array& chars(Object* string) {
+        return *value.in(string).value.object->array;
+    }
+};
+
+typedef std::shared_ptr<StringFields> StringFieldsPtr;
+
+Object* nonNull(const Variable& variable) {
+    if (variable.value.object == nullptr){
+        throw std::invalid_argument("NullPointerException in String intrinsic");
+    }
+    return variable.value.object;
+}
+
+Variable booleanResult(bool value) {
+    return Variable((int32_t) (value ? 1 : 0));
+}
+
+/** s[0]*31^(n-1) + ... + s[n-1], in 32 bit arithmetic like Java.
+    Four chars are folded per step, so the multiplications don't depend on each other. */
+int32_t hashChars(const uint16_t* chars, uint32_t length) {
+    const uint32_t p1 = 31;
+    const uint32_t p2 = p1 * p1;
+    const uint32_t p3 = p2 * p1;
+    const uint32_t p4 = p2 * p2;
+    uint32_t h = 0;
+    uint32_t i = 0;
+    for (; i + 4 <= length; i += 4){
+        h = h * p4 + chars[i] * p3 + chars[i + 1] * p2 + chars[i + 2] * p1 + chars[i + 3];
+    }
+    for (; i < length; i++){
+        h = h * p1 + chars[i];
+    }
+    return (int32_t) h;
+}
+
+/** String.indexOf(int, int) */
+int32_t indexOfChar(const Array& chars, int32_t ch, int32_t fromIndex) {
+    const uint16_t* data = chars.data<uint16_t>();
+    int32_t length = (int32_t) chars.length;
+    if (fromIndex < 0){
+        fromIndex = 0;
+    }
+    if (fromIndex >= length){
+        return -1;
+    }
+    if (ch < 0x10000){
+        if (ch < 0){
+            return -1;
+        }
+        const uint16_t* found = std::find(data + fromIndex, data + length, (uint16_t) ch);
+        return found == data + length ? -1 : (int32_t) (found - data);
+    }
+    if (ch > 0x10ffff){
+        return -1;
+    }
+    // Supplementary code point, search its surrogate pair
+    uint16_t high = (uint16_t) (((ch - 0x10000) >> 10) + 0xd800);
+    uint16_t low = (uint16_t) (((ch - 0x10000) & 0x3ff) + 0xdc00);
+    for (int32_t i = fromIndex; i < length - 1; i++){
+        if (data[i] == high && data[i + 1] == low){
+            return i;
+        }
+    }
+    return -1;
+}
+
+/** AbstractStringBuilder.ensureCapacityInternal, makes room for minimumCapacity chars. */
+Array& ensureCapacity(StringFields& fields, VmMemory& memory, Object* builder, int32_t minimumCapacity) {
+    Variable& valueField = fields.builderValue.in(builder);
+    Array* value = valueField.value.object->array;
+    if (minimumCapacity < 0){
+        throw std::invalid_argument("OutOfMemoryError, StringBuilder too large");
+    }
+    if ((uint32_t) minimumCapacity <= value->length){
+        return *value;
+    }
+    int64_t newCapacity = ((int64_t) value->length << 1) + 2;
+    if (newCapacity < minimumCapacity){
+        newCapacity = minimumCapacity;
+    }
+    // No collection can happen here, the old value stays valid while copying
+    Variable grown = memory.allocateArray(Char, (size_t) newCapacity);
+    int32_t count = fields.builderCount.in(builder).value.iv;
+    Array::copy(*value, 0, *grown.array(), 0, count);
+    valueField.value.object = grown.value.object;
+    return *grown.array();
+}
+
+void appendChars(StringFields& fields, VmMemory& memory, Object* builder, const uint16_t* chars, uint32_t length) {
+    Variable& countField = fields.builderCount.in(builder);
+    int32_t count = countField.value.iv;
+    Array& value = ensureCapacity(fields, memory, builder, count + (int32_t) length);
+    std::copy(chars, chars + length, value.data<uint16_t>() + count);
+    countField.value.iv = count + (int32_t) length;
+}
+
+}
+
+void MethodOverrides::addStringIntrinsics() {
+    StringFieldsPtr fields = std::make_shared<StringFields>();
+
+    add("java/lang/String", "hashCode", "()I", [fields](const FunctionContext&, const LocalArray& variables) {
+        assert(variables.size() == 1);
+        Object* thisp = variables.variables[0].value.object;
+        Variable& hash = fields->hash.in(thisp);
+        const Array& chars = fields->chars(thisp);
+        if (hash.value.iv == 0 && chars.length > 0){
+            hash.value.iv = hashChars(chars.data<uint16_t>(), chars.length);
+        }
+        return Variable(hash.value.iv);
+    });
+    add("java/lang/String", "equals", "(Ljava/lang/Object;)Z", [fields](const FunctionContext&, const LocalArray& variables) {
+        assert(variables.size() == 2);
+        Object* thisp = variables.variables[0].value.object;
+        Object* other = variables.variables[1].value.object;
+        if (thisp == other){
+            return booleanResult(true);
+        }
+        // String is final, so instanceof is a class comparison
+        if (other == nullptr || other->type != thisp->type){
+            return booleanResult(false);
+        }
+        const Array& a = fields->chars(thisp);
+        const Array& b = fields->chars(other);
+        return booleanResult(a.length == b.length && std::memcmp(a.elements, b.elements, a.length * sizeof(uint16_t)) == 0);
+    });
+    add("java/lang/String", "charAt", "(I)C", [fields](const FunctionContext&, const LocalArray& variables) {
+        assert(variables.size() == 2);
+        const Array& chars = fields->chars(variables.variables[0].value.object);
+        int32_t index = variables.variables[1].value.iv;
+        if (index < 0 || (uint32_t) index >= chars.length){
+            throw std::invalid_argument("StringIndexOutOfBoundsException: String index out of range: " + util::toString(index));
+        }
+        Variable result (Char);
+        result.value.iv = chars.at<uint16_t>(index);
+        return result;
+    });
+    add("java/lang/String", "indexOf", "(I)I", [fields](const FunctionContext&, const LocalArray& variables) {
+        assert(variables.size() == 2);
+        const Array& chars = fields->chars(variables.variables[0].value.object);
+        return Variable(indexOfChar(chars, variables.variables[1].value.iv, 0));
+    });
+    add("java/lang/String", "indexOf", "(II)I", [fields](const FunctionContext&, const LocalArray& variables) {
+        assert(variables.size() == 3);
+        const Array& chars = fields->chars(variables.variables[0].value.object);
+        return Variable(indexOfChar(chars, variables.variables[1].value.iv, variables.variables[2].value.iv));
+    });
+    add("java/lang/String", "compareTo", "(Ljava/lang/String;)I", [fields](const FunctionContext&, const LocalArray& variables) {
+        assert(variables.size() == 2);
+        const Array& a = fields->chars(variables.variables[0].value.object);
+        const Array& b = fields->chars(nonNull(variables.variables[1]));
+        const uint16_t* aChars = a.data<uint16_t>();
+        const uint16_t* bChars = b.data<uint16_t>();
+        uint32_t limit = std::min(a.length, b.length);
+        auto difference = std::mismatch(aChars, aChars + limit, bChars);
+        if (difference.first != aChars + limit){
+            return Variable((int32_t) *difference.first - (int32_t) *difference.second);
+        }
+        return Variable((int32_t) a.length - (int32_t) b.length);
+    });
+    add("java/lang/StringBuilder", "append", "(C)Ljava/lang/StringBuilder;", [fields](const FunctionContext& context, const LocalArray& variables) {
+        assert(variables.size() == 2);
+        Object* thisp = variables.variables[0].value.object;
+        uint16_t c = (uint16_t) variables.variables[1].value.iv;
+        appendChars(*fields, *context.memory, thisp, &c, 1);
+        return variables.variables[0];
+    });
+    add("java/lang/StringBuilder", "append", "(Ljava/lang/String;)Ljava/lang/StringBuilder;", [fields](const FunctionContext& context, const LocalArray& variables) {
+        assert(variables.size() == 2);
+        Object* thisp = variables.variables[0].value.object;
+        Object* string = variables.variables[1].value.object;
+        if (string == nullptr){
+            static const uint16_t nullChars[] = { 'n', 'u', 'l', 'l' };
+            appendChars(*fields, *context.memory, thisp, nullChars, 4);
+        } else {
+            const Array& chars = fields->chars(string);
+            appendChars(*fields, *context.memory, thisp, chars.data<uint16_t>(), chars.length);
+        }
+        return variables.variables[0];
+    });
+}
@@ -0,0 +1,67 @@
+#include "Symbol.h"
+#include <unordered_set>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+
+namespace {
+
+/** Symbols by content. */
+struct ContentHash {
+    size_t operator()(const Symbol* symbol) const {
+        return symbol->hash();
+    }
+};
+
+struct ContentEqual {
+    bool operator()(const Symbol* a, const Symbol* b) const {
+        return a->str() == b->str();
+    }
+};
+
+struct SymbolTable {
+    boost::mutex mutex;
+    std::unordered_set<const Symbol*, ContentHash, ContentEqual> symbols;
+};
+
+SymbolTable& table() {
+    // Never destroyed, symbols may still be used by static destructors
+    static SymbolTable* table = new SymbolTable();
+    return *table;
+}
+
+}
+
+Symbol::Symbol(std::string content) : mString(std::move(content)) {
+    mHash = hash::stringHash(mString);
+}
+
+const Symbol* Symbol::intern(const char* data, size_t length) {
+    return intern(std::string(data, length));
+}
+
+const Symbol* Symbol::intern(const std::string& content) {
+    Symbol probe (content);
+    auto& symbols = table();
+    boost::lock_guard<boost::mutex> lock (symbols.mutex);
+    auto i = symbols.symbols.find(&probe);
+    if (i != symbols.symbols.end()){
+        return *i;
+    }
+    const Symbol* symbol = new Symbol(std::move(probe.mString));
+    symbols.symbols.insert(symbol);
+    return symbol;
+}
+
+const Symbol* Symbol::find(const std::string& content) {
+    Symbol probe (content);
+    auto& symbols = table();
+    boost::lock_guard<boost::mutex> lock (symbols.mutex);
+    auto i = symbols.symbols.find(&probe);
+    return i == symbols.symbols.end() ? nullptr : *i;
+}
+
+size_t Symbol::count() {
+    auto& symbols = table();
+    boost::lock_guard<boost::mutex> lock (symbols.mutex);
+    return symbols.symbols.size();
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <string>
+#include <ostream>
+#include <utility>
+#include <boost/noncopyable.hpp>
+#include "types.h"
+
+/** An interned UTF8 string, like a class, method or field name or a descriptor.
+    There is one Symbol per content, so symbols are compared by pointer and their hash is computed once.
+    Symbols live as long as the process (like loaded classes), interning is thread safe. */
+class Symbol : boost::noncopyable {
+public:
+    /** Returns the symbol of a content, creating it on first use. */
+    static const Symbol* intern(const std::string& content);
+    static const Symbol* intern(const char* data, size_t length);
+
+    /** Returns the symbol of a content, or null if nothing interned it yet (so nothing can refer to it). */
+    static const Symbol* find(const std::string& content);
+
+    /** Number of interned symbols. */
+    static size_t count();
+
+    const std::string& str() const { return mString; }
+
+    size_t hash() const { return mHash; }
+
+private:
+    explicit Symbol(std::string content);
+
+    std::string mString;
+    size_t mHash;
+};
+
+inline std::ostream& operator<<(std::ostream& stream, const Symbol& symbol) {
+    return stream << symbol.str();
+}
+
+/** Name and descriptor of a method, e.g. as key of method tables. */
+typedef std::pair<const Symbol*, const Symbol*> SymbolPair;
+
+namespace hash {
+
+/** Hashes symbol pointers with their precomputed hash, for unordered containers. */
+struct SymbolHash {
+    size_t operator()(const Symbol* symbol) const {
+        return symbol->hash();
+    }
+    size_t operator()(const SymbolPair& pair) const {
+        return combineHash(pair.first->hash(), pair.second->hash());
+    }
+};
+
+}
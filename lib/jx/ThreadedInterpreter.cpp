@@ -0,0 +1,745 @@
+#include "Interpreter.h"
+#include "Ops.h"
+#include "Log.h"
+#include <climits>
+#include <atomic>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+
+#ifdef JX_THREADED_DISPATCH
+
+#ifndef __GNUC__
+#error "JX_THREADED_DISPATCH needs labels as values (GCC/Clang)"
+#endif
+
+// Threaded interpreter: each method is translated once into a vector of Instructions,
+// holding the address of their handler label and decoded operands. Dispatching is a single
+// indirect jump at the end of each handler. Op codes without own handler run through
+// Interpreter::executeInstruction, so both engines share their implementation.
+// Instructions referencing the constant pool resolve it on their first execution and
+// rewrite themselves to a quick variant (e.g. getfield -> getfield_quick <slot>).
+// Virtual call sites additionally cache their receiver classes (see InlineCache).
+
+namespace {
+
+/** Length of the instruction at pc, including the op code. */
+size_t instructionLength(const ByteRange& bytes, ByteRange::Iterator pc) {
+    uint8_t op = *pc;
+    switch (op){
+        case ops::bipush:
+        case ops::ldc:
+        case ops::iload:
+        case ops::lload:
+        case ops::fload:
+        case ops::dload:
+        case ops::aload:
+        case ops::istore:
+        case ops::lstore:
+        case ops::fstore:
+        case ops::dstore:
+        case ops::astore:
+        case ops::ret:
+        case ops::newarray:
+            return 2;
+        case ops::sipush:
+        case ops::ldc_w:
+        case ops::ldc2_w:
+        case ops::iinc:
+        case ops::goto_:
+        case ops::jsr:
+        case ops::getstatic:
+        case ops::putstatic:
+        case ops::getfield:
+        case ops::putfield:
+        case ops::invokevirtual:
+        case ops::invokespecial:
+        case ops::invokestatic:
+        case ops::new_:
+        case ops::anewarray:
+        case ops::checkcast:
+        case ops::instanceof:
+        case ops::ifnull:
+        case ops::ifnonnull:
+            return 3;
+        case ops::multianewarray:
+            return 4;
+        case ops::invokeinterface:
+        case ops::invokedynamic:
+        case ops::goto_w:
+        case ops::jsr_w:
+            return 5;
+        case ops::wide:
+            return bytes.fetchUint8(pc + 1) == ops::iinc ? 6 : 4;
+        case ops::tableswitch:
+        case ops::lookupswitch: {
+            size_t offset = pc - bytes.begin + 1;
+            offset += (4 - offset % 4) % 4;
+            auto table = bytes.begin + offset;
+            if (op == ops::tableswitch){
+                int32_t low = bytes.fetchInt32(table + 4);
+                int32_t high = bytes.fetchInt32(table + 8);
+                return offset + 12 + 4 * (size_t)((int64_t)high - low + 1) - (pc - bytes.begin);
+            }
+            int32_t nPairs = bytes.fetchInt32(table + 4);
+            return offset + 8 + 8 * (size_t)nPairs - (pc - bytes.begin);
+        }
+        default:
+            if (op >= ops::ifeq && op <= ops::if_acmpne){
+                return 3;
+            }
+            return 1;
+    }
+}
+
+bool isBranch(uint8_t op) {
+    return (op >= ops::ifeq && op <= ops::if_acmpne) || op == ops::goto_ || op == ops::ifnull || op == ops::ifnonnull;
+}
+
+}
+
+std::unique_ptr<ThreadedCode> Interpreter::translate(const PreparedMethod& prepared, const void* const* handlers, const void* genericHandler, const void* endHandler) {
+    const CodeIdentifier& code = prepared.code;
+    const ByteRange& bytes = code.code;
+    size_t codeLength = bytes.end - bytes.begin;
+
+    std::unique_ptr<ThreadedCode> result (new ThreadedCode());
+    result->indexByPc.resize(codeLength + 1, -1);
+
+    for (auto pc = bytes.begin; pc < bytes.end; pc += instructionLength(bytes, pc)){
+        uint8_t op = *pc;
+        Instruction instruction;
+        instruction.op = op;
+        instruction.pc = pc - bytes.begin;
+        instruction.handler = handlers[op] ? handlers[op] : genericHandler;
+
+        switch (op){
+            case ops::iconst_m1:
+            case ops::iconst_0:
+            case ops::iconst_1:
+            case ops::iconst_2:
+            case ops::iconst_3:
+            case ops::iconst_4:
+            case ops::iconst_5:
+                instruction.operand = (int32_t)op - ops::iconst_0;
+                break;
+            case ops::bipush:
+                instruction.operand = bytes.fetchInt8(pc + 1);
+                break;
+            case ops::sipush:
+                instruction.operand = bytes.fetchInt16(pc + 1);
+                break;
+            case ops::iload:
+            case ops::lload:
+            case ops::fload:
+            case ops::dload:
+            case ops::aload:
+            case ops::istore:
+            case ops::lstore:
+            case ops::fstore:
+            case ops::dstore:
+            case ops::astore:
+                instruction.operand = bytes.fetchUint8(pc + 1);
+                break;
+            case ops::iinc:
+                instruction.operand = bytes.fetchUint8(pc + 1);
+                instruction.operand2 = bytes.fetchInt8(pc + 2);
+                break;
+            case ops::ldc:
+                instruction.operand = bytes.fetchUint8(pc + 1);
+                break;
+            case ops::ldc_w:
+            case ops::getstatic:
+            case ops::putstatic:
+            case ops::getfield:
+            case ops::putfield:
+            case ops::invokevirtual:
+            case ops::invokespecial:
+            case ops::invokestatic:
+            case ops::invokeinterface:
+            case ops::new_:
+                instruction.operand = bytes.fetchUint16(pc + 1);
+                break;
+            default:
+                if (op >= ops::iload_0 && op <= ops::aload_3){
+                    instruction.operand = (op - ops::iload_0) % 4;
+                } else if (op >= ops::istore_0 && op <= ops::astore_3){
+                    instruction.operand = (op - ops::istore_0) % 4;
+                } else if (isBranch(op)){
+                    // Relative target, fixed below
+                    instruction.operand = bytes.fetchInt16(pc + 1);
+                }
+                break;
+        }
+        bool isLocalAccess = (op >= ops::iload && op <= ops::aload_3) || (op >= ops::istore && op <= ops::astore_3) || op == ops::iinc;
+        if (isLocalAccess && instruction.operand >= code.maxLocals){
+            // Let the reference implementation complain
+            instruction.handler = genericHandler;
+        }
+
+        result->indexByPc[instruction.pc] = (int32_t) result->instructions.size();
+        result->instructions.push_back(instruction);
+    }
+
+    Instruction end;
+    end.handler = endHandler;
+    end.pc = codeLength;
+    result->indexByPc[codeLength] = (int32_t) result->instructions.size();
+    result->instructions.push_back(end);
+
+    // Instructions don't move anymore
+    size_t callSites = 0;
+    for (const Instruction& instruction : result->instructions){
+        if (instruction.op == ops::invokevirtual || instruction.op == ops::invokeinterface){
+            callSites++;
+        }
+    }
+    result->inlineCaches.resize(callSites);
+    callSites = 0;
+    for (Instruction& instruction : result->instructions){
+        if (instruction.op == ops::invokevirtual || instruction.op == ops::invokeinterface){
+            InlineCache& cache = result->inlineCaches[callSites++];
+            cache.pc = instruction.pc;
+            instruction.cache = &cache;
+        }
+        if (isBranch(instruction.op) && instruction.handler != genericHandler){
+            int64_t target = (int64_t) instruction.pc + instruction.operand;
+            if (target < 0 || target >= (int64_t) codeLength){
+                throw std::invalid_argument("Jump target out of code in " + prepared.clazz->name() + " " + prepared.methodName->str());
+            }
+            instruction.target = result->atPc((size_t) target);
+        }
+    }
+    logd("Translated ", prepared.clazz->name(), *prepared.methodName, "into", result->instructions.size(), "instructions");
+    return result;
+}
+
+#define DISPATCH() goto *ins->handler
+#define NEXT() do { ++ins; DISPATCH(); } while (0)
+#define JUMP_IF(CONDITION) do { if (CONDITION) { ins = ins->target; pollStackSampler(); } else { ++ins; } DISPATCH(); } while (0)
+#define HANDLER(OPCODE, LABEL) handlers[OPCODE] = &&LABEL
+
+#define THREADED_TRIVIAL_OP(LABEL,TYPE,ACCESSOR,OP) \
+    LABEL: { \
+        auto v2 = frame.stack.pop(); \
+        auto v1 = frame.stack.pop(); \
+        assert (v1.type == TYPE); \
+        assert (v2.type == TYPE); \
+        Variable r (TYPE); \
+        r.value.ACCESSOR = v1.value.ACCESSOR OP v2.value.ACCESSOR; \
+        frame.stack.push(r); \
+        NEXT(); \
+    }
+
+Variable Interpreter::executeThreaded(Frame& frame, const ClassFile& clazz, const PreparedMethod& prepared) {
+    static const void* handlers[256] = { nullptr };
+    // Filled by the first call, Interpreters on other threads may race for it
+    static std::atomic<bool> handlersInitialized (false);
+    if (!handlersInitialized.load(std::memory_order_acquire)){
+        static boost::mutex handlersMutex;
+        boost::lock_guard<boost::mutex> lock (handlersMutex);
+        if (!handlersInitialized.load(std::memory_order_relaxed)){
+            HANDLER(ops::nop, op_nop);
+            for (int op = ops::iconst_m1; op <= ops::iconst_5; op++){
+                handlers[op] = &&op_iconst;
+            }
+            HANDLER(ops::bipush, op_iconst);
+            HANDLER(ops::sipush, op_sipush);
+            HANDLER(ops::aconst_null, op_aconst_null);
+            for (int op = ops::iload; op <= ops::dload; op++){
+                handlers[op] = &&op_load;
+            }
+            HANDLER(ops::aload, op_aload);
+            for (int op = ops::iload_0; op <= ops::aload_3; op++){
+                handlers[op] = &&op_load;
+            }
+            for (int op = ops::istore; op <= ops::astore; op++){
+                handlers[op] = &&op_store;
+            }
+            for (int op = ops::istore_0; op <= ops::astore_3; op++){
+                handlers[op] = &&op_store;
+            }
+            HANDLER(ops::iinc, op_iinc);
+            HANDLER(ops::dup, op_dup);
+            HANDLER(ops::pop, op_pop);
+            HANDLER(ops::iadd, op_iadd);
+            HANDLER(ops::isub, op_isub);
+            HANDLER(ops::imul, op_imul);
+            HANDLER(ops::iand, op_iand);
+            HANDLER(ops::ior, op_ior);
+            HANDLER(ops::ixor, op_ixor);
+            HANDLER(ops::ladd, op_ladd);
+            HANDLER(ops::lsub, op_lsub);
+            HANDLER(ops::lmul, op_lmul);
+            HANDLER(ops::dadd, op_dadd);
+            HANDLER(ops::dsub, op_dsub);
+            HANDLER(ops::dmul, op_dmul);
+            HANDLER(ops::fadd, op_fadd);
+            HANDLER(ops::fsub, op_fsub);
+            HANDLER(ops::fmul, op_fmul);
+            HANDLER(ops::ifeq, op_ifeq);
+            HANDLER(ops::ifne, op_ifne);
+            HANDLER(ops::iflt, op_iflt);
+            HANDLER(ops::ifge, op_ifge);
+            HANDLER(ops::ifgt, op_ifgt);
+            HANDLER(ops::ifle, op_ifle);
+            HANDLER(ops::if_icmpeq, op_if_icmpeq);
+            HANDLER(ops::if_icmpne, op_if_icmpne);
+            HANDLER(ops::if_icmplt, op_if_icmplt);
+            HANDLER(ops::if_icmpge, op_if_icmpge);
+            HANDLER(ops::if_icmpgt, op_if_icmpgt);
+            HANDLER(ops::if_icmple, op_if_icmple);
+            HANDLER(ops::if_acmpeq, op_if_acmpeq);
+            HANDLER(ops::if_acmpne, op_if_acmpne);
+            HANDLER(ops::ifnull, op_ifnull);
+            HANDLER(ops::ifnonnull, op_ifnonnull);
+            HANDLER(ops::goto_, op_goto);
+            HANDLER(ops::arraylength, op_arraylength);
+            HANDLER(ops::iaload, op_iaload);
+            HANDLER(ops::laload, op_laload);
+            HANDLER(ops::faload, op_faload);
+            HANDLER(ops::daload, op_daload);
+            HANDLER(ops::aaload, op_aaload);
+            HANDLER(ops::baload, op_baload);
+            HANDLER(ops::caload, op_caload);
+            HANDLER(ops::saload, op_saload);
+            HANDLER(ops::iastore, op_iastore);
+            HANDLER(ops::lastore, op_lastore);
+            HANDLER(ops::fastore, op_fastore);
+            HANDLER(ops::dastore, op_dastore);
+            HANDLER(ops::aastore, op_aastore);
+            HANDLER(ops::bastore, op_bastore);
+            HANDLER(ops::castore, op_castore);
+            HANDLER(ops::sastore, op_sastore);
+            HANDLER(ops::ldc, op_ldc);
+            HANDLER(ops::ldc_w, op_ldc);
+            HANDLER(ops::new_, op_new);
+            HANDLER(ops::getfield, op_getfield);
+            HANDLER(ops::putfield, op_putfield);
+            HANDLER(ops::getstatic, op_getstatic);
+            HANDLER(ops::putstatic, op_putstatic);
+            HANDLER(ops::invokestatic, op_invokedirect);
+            HANDLER(ops::invokespecial, op_invokedirect);
+            HANDLER(ops::invokevirtual, op_invokevirtual);
+            HANDLER(ops::invokeinterface, op_invokeinterface);
+            HANDLER(ops::ireturn, op_ireturn);
+            HANDLER(ops::lreturn, op_lreturn);
+            HANDLER(ops::freturn, op_freturn);
+            HANDLER(ops::dreturn, op_dreturn);
+            HANDLER(ops::areturn, op_areturn);
+            HANDLER(ops::return_, op_return);
+            handlersInitialized.store(true, std::memory_order_release);
+        }
+    }
+
+    if (!prepared.threadedCode){
+        prepared.threadedCode = translate(prepared, handlers, &&op_generic, &&op_end);
+        mTranslatedMethods.push_back(&prepared);
+    }
+    ThreadedCode& code = *prepared.threadedCode;
+    const ByteRange& bytes = prepared.code.code;
+    Variable* locals = frame.localArray.variables;
+
+    Instruction* ins = &code.instructions[0];
+    DISPATCH();
+
+    op_generic: {
+        auto pc = bytes.begin + ins->pc;
+        Variable returnValue;
+        if (executeInstruction(frame, clazz, bytes, pc, returnValue)){
+            return returnValue;
+        }
+        ins = code.atPc(pc - bytes.begin);
+        DISPATCH();
+    }
+    op_end:
+        logt("Leaving... ");
+        return Variable();
+
+    op_nop:
+        NEXT();
+    op_iconst:
+        frame.stack.push(Variable(ins->operand));
+        NEXT();
+    op_sipush: {
+        Variable v(Short);
+        v.value.iv = ins->operand;
+        frame.stack.push(v);
+        NEXT();
+    }
+    op_aconst_null: {
+        Variable v;
+        v.type = ObjectRef;
+        v.value.object = nullptr;
+        frame.stack.push(v);
+        NEXT();
+    }
+    op_load:
+        frame.stack.push(locals[ins->operand]);
+        NEXT();
+    op_aload: {
+        Variable v = locals[ins->operand];
+        if (v.type == None){
+            v = Variable(ObjectRef); // workaround
+        }
+        frame.stack.push(v);
+        NEXT();
+    }
+    op_store:
+        locals[ins->operand] = frame.stack.pop();
+        NEXT();
+    op_iinc: {
+        Variable & local = locals[ins->operand];
+        assert(local.type == Integer);
+        local.value.iv += ins->operand2;
+        NEXT();
+    }
+    op_dup:
+        frame.stack.push(frame.stack.top());
+        NEXT();
+    op_pop:
+        frame.stack.pop();
+        NEXT();
+    op_iadd: {
+        auto v2 = frame.stack.pop();
+        auto v1 = frame.stack.pop();
+        frame.stack.push(Variable(v1.value.iv + v2.value.iv));
+        NEXT();
+    }
+    op_isub: {
+        auto v2 = frame.stack.pop();
+        auto v1 = frame.stack.pop();
+        frame.stack.push(Variable(v1.value.iv - v2.value.iv));
+        NEXT();
+    }
+    op_imul: {
+        auto v2 = frame.stack.pop();
+        auto v1 = frame.stack.pop();
+        assert (v1.isStoredAsInteger());
+        assert (v2.isStoredAsInteger());
+        Variable r (Integer);
+        r.value.iv = v1.value.iv * v2.value.iv;
+        frame.stack.push(r);
+        NEXT();
+    }
+    op_iand: {
+        auto v2 = frame.stack.pop();
+        auto v1 = frame.stack.pop();
+        frame.stack.push(Variable(v1.value.iv & v2.value.iv));
+        NEXT();
+    }
+    op_ior: {
+        auto v2 = frame.stack.pop();
+        auto v1 = frame.stack.pop();
+        frame.stack.push(Variable(v1.value.iv | v2.value.iv));
+        NEXT();
+    }
+    op_ixor: {
+        auto v2 = frame.stack.pop();
+        auto v1 = frame.stack.pop();
+        assert (v1.type == Integer);
+        assert (v2.type == Integer);
+        frame.stack.push(Variable(v1.value.iv ^ v2.value.iv));
+        NEXT();
+    }
+    THREADED_TRIVIAL_OP(op_ladd, Long, lv, +)
+    THREADED_TRIVIAL_OP(op_lsub, Long, lv, -)
+    THREADED_TRIVIAL_OP(op_lmul, Long, lv, *)
+    THREADED_TRIVIAL_OP(op_dadd, Double, dv, +)
+    THREADED_TRIVIAL_OP(op_dsub, Double, dv, -)
+    THREADED_TRIVIAL_OP(op_dmul, Double, dv, *)
+    THREADED_TRIVIAL_OP(op_fadd, Float, fv, +)
+    THREADED_TRIVIAL_OP(op_fsub, Float, fv, -)
+    THREADED_TRIVIAL_OP(op_fmul, Float, fv, *)
+
+    op_ifeq: {
+        Variable top = frame.stack.pop();
+        assert(top.type == Integer || top.type == Boolean);
+        JUMP_IF(top.value.iv == 0);
+    }
+    op_ifne: {
+        Variable top = frame.stack.pop();
+        assert(top.type == Integer || top.type == Boolean);
+        JUMP_IF(top.value.iv != 0);
+    }
+    op_iflt: {
+        Variable top = frame.stack.pop();
+        assert(top.isStoredAsInteger());
+        JUMP_IF(top.value.iv < 0);
+    }
+    op_ifge: {
+        Variable top = frame.stack.pop();
+        assert(top.isStoredAsInteger());
+        JUMP_IF(top.value.iv >= 0);
+    }
+    op_ifgt: {
+        Variable top = frame.stack.pop();
+        assert(top.isStoredAsInteger());
+        JUMP_IF(top.value.iv > 0);
+    }
+    op_ifle: {
+        Variable top = frame.stack.pop();
+        assert(top.isStoredAsInteger());
+        JUMP_IF(top.value.iv <= 0);
+    }
+    op_if_icmpeq: {
+        Variable v2 = frame.stack.pop();
+        Variable v1 = frame.stack.pop();
+        assert(v2.isStoredAsInteger());
+        assert(v1.isStoredAsInteger());
+        JUMP_IF(v1.value.iv == v2.value.iv);
+    }
+    op_if_icmpne: {
+        Variable v2 = frame.stack.pop();
+        Variable v1 = frame.stack.pop();
+        assert(v2.isStoredAsInteger());
+        assert(v1.isStoredAsInteger());
+        JUMP_IF(v1.value.iv != v2.value.iv);
+    }
+    op_if_icmplt: {
+        Variable v2 = frame.stack.pop();
+        Variable v1 = frame.stack.pop();
+        assert(v2.isStoredAsInteger());
+        assert(v1.isStoredAsInteger());
+        JUMP_IF(v1.value.iv < v2.value.iv);
+    }
+    op_if_icmpge: {
+        Variable v2 = frame.stack.pop();
+        Variable v1 = frame.stack.pop();
+        assert(v2.isStoredAsInteger());
+        assert(v1.isStoredAsInteger());
+        JUMP_IF(v1.value.iv >= v2.value.iv);
+    }
+    op_if_icmpgt: {
+        Variable v2 = frame.stack.pop();
+        Variable v1 = frame.stack.pop();
+        assert(v2.isStoredAsInteger());
+        assert(v1.isStoredAsInteger());
+        JUMP_IF(v1.value.iv > v2.value.iv);
+    }
+    op_if_icmple: {
+        Variable v2 = frame.stack.pop();
+        Variable v1 = frame.stack.pop();
+        assert(v2.isStoredAsInteger());
+        assert(v1.isStoredAsInteger());
+        JUMP_IF(v1.value.iv <= v2.value.iv);
+    }
+    op_if_acmpeq: {
+        Variable v2 = frame.stack.pop();
+        Variable v1 = frame.stack.pop();
+        assert (v2.type == ObjectRef);
+        assert (v1.type == ObjectRef);
+        JUMP_IF(v1.value.object == v2.value.object);
+    }
+    op_if_acmpne: {
+        Variable v2 = frame.stack.pop();
+        Variable v1 = frame.stack.pop();
+        assert (v2.type == ObjectRef);
+        assert (v1.type == ObjectRef);
+        JUMP_IF(v1.value.object != v2.value.object);
+    }
+    op_ifnull: {
+        Variable top = frame.stack.pop();
+        assert(top.type == ObjectRef || top.type == ArrayRef);
+        JUMP_IF(top.value.object == nullptr);
+    }
+    op_ifnonnull: {
+        Variable top = frame.stack.pop();
+        assert(top.type == ObjectRef || top.type == ArrayRef);
+        JUMP_IF(top.value.object != nullptr);
+    }
+    op_goto:
+        ins = ins->target;
+        pollStackSampler();
+        DISPATCH();
+
+    op_arraylength: {
+        Variable top = frame.stack.pop();
+        assert(top.isArray());
+        uint32_t len = top.array()->length;
+        assert (len <= INT_MAX);
+        frame.stack.push(Variable((int32_t)len));
+        NEXT();
+    }
+    op_iaload:
+        arrayLoad<int32_t>(frame.stack, Integer);
+        NEXT();
+    op_laload:
+        arrayLoad<int64_t>(frame.stack, Long);
+        NEXT();
+    op_faload:
+        arrayLoad<float>(frame.stack, Float);
+        NEXT();
+    op_daload:
+        arrayLoad<double>(frame.stack, Double);
+        NEXT();
+    op_aaload:
+        arrayLoad<Object*>(frame.stack, ObjectRef);
+        NEXT();
+    op_baload:
+        arrayLoad<int8_t>(frame.stack, Byte);
+        NEXT();
+    op_caload:
+        arrayLoad<uint16_t>(frame.stack, Char);
+        NEXT();
+    op_saload:
+        arrayLoad<int16_t>(frame.stack, Short);
+        NEXT();
+    op_iastore:
+        arrayStore<int32_t>(frame.stack);
+        NEXT();
+    op_lastore:
+        arrayStore<int64_t>(frame.stack);
+        NEXT();
+    op_fastore:
+        arrayStore<float>(frame.stack);
+        NEXT();
+    op_dastore:
+        arrayStore<double>(frame.stack);
+        NEXT();
+    op_aastore:
+        arrayStore<Object*>(frame.stack);
+        NEXT();
+    op_bastore:
+        arrayStore<int8_t>(frame.stack);
+        NEXT();
+    op_castore:
+        arrayStore<uint16_t>(frame.stack);
+        NEXT();
+    op_sastore:
+        arrayStore<int16_t>(frame.stack);
+        NEXT();
+
+    // Resolving handlers, rewrite the instruction to the quick variant and execute it
+    op_ldc: {
+        const ConstantEntry& constant = clazz.constantEntry(ins->operand);
+        switch (constant.tag){
+            case ConstantEntry::IntegerTag:
+            case ConstantEntry::FloatTag:
+                ins->operand = constant.integerValue();
+                ins->operand2 = constant.tag == ConstantEntry::IntegerTag ? Integer : Float;
+                ins->handler = &&op_ldc_value_quick;
+                break;
+            case ConstantEntry::StringTag:
+                ins->object = resolveString(clazz, ins->operand, frame).string;
+                ins->handler = &&op_ldc_string_quick;
+                break;
+            default:
+                ins->handler = &&op_generic;
+                break;
+        }
+        DISPATCH();
+    }
+    op_new:
+        // No ClassFilePtr local, computed gotos leave the scope without running destructors
+        ins->clazz = findInitializedClass(clazz.classSymbol(ins->operand)).get();
+        logt("Allocating class ", ins->clazz->name());
+        ins->handler = &&op_new_quick;
+        DISPATCH();
+    op_getfield:
+        ins->operand = resolveField(clazz, ins->operand).fieldSlot;
+        ins->handler = &&op_getfield_quick;
+        DISPATCH();
+    op_putfield:
+        ins->operand = resolveField(clazz, ins->operand).fieldSlot;
+        ins->handler = &&op_putfield_quick;
+        DISPATCH();
+    op_getstatic:
+        ins->staticField = resolveStaticField(clazz, ins->operand).staticField;
+        ins->handler = &&op_getstatic_quick;
+        DISPATCH();
+    op_putstatic:
+        ins->staticField = resolveStaticField(clazz, ins->operand).staticField;
+        ins->handler = &&op_putstatic_quick;
+        DISPATCH();
+    op_invokedirect:
+        ins->reference = &resolveMethod(clazz, ins->operand);
+        ins->handler = &&op_invokedirect_quick;
+        DISPATCH();
+    op_invokevirtual:
+        ins->cache->reference = &resolveVirtualMethod(clazz, ins->operand, false);
+        ins->handler = &&op_invokevirtual_quick;
+        DISPATCH();
+    op_invokeinterface:
+        ins->cache->reference = &resolveVirtualMethod(clazz, ins->operand, true);
+        ins->handler = &&op_invokevirtual_quick;
+        DISPATCH();
+
+    // Quick variants
+    op_ldc_value_quick: {
+        Variable v ((VariableType) ins->operand2);
+        v.value.iv = ins->operand;
+        frame.stack.push(v);
+        NEXT();
+    }
+    op_ldc_string_quick:
+        frame.stack.push(Variable(ins->object));
+        NEXT();
+    op_new_quick:
+        safepoint();
+        frame.stack.push(mMemory.allocateObject(ins->clazz->shared_from_this()));
+        NEXT();
+    op_getfield_quick: {
+        Variable objectRef = frame.stack.pop();
+        assert(objectRef.type == ObjectRef);
+        assert(objectRef.value.object != nullptr);
+        assert((size_t) ins->operand < objectRef.value.object->fields.size());
+        frame.stack.push(objectRef.value.object->fields[ins->operand]);
+        NEXT();
+    }
+    op_putfield_quick: {
+        Variable v = frame.stack.pop();
+        Variable objectRef = frame.stack.pop();
+        assert(objectRef.type == ObjectRef);
+        assert(objectRef.value.object != nullptr);
+        assert((size_t) ins->operand < objectRef.value.object->fields.size());
+        objectRef.value.object->fields[ins->operand] = v;
+        NEXT();
+    }
+    op_getstatic_quick:
+        frame.stack.push(*ins->staticField);
+        NEXT();
+    op_putstatic_quick:
+        VmMemory::storeGlobal(ins->staticField, frame.stack.pop());
+        NEXT();
+    op_invokedirect_quick:
+        invokeDirect(frame, *ins->reference);
+        NEXT();
+    op_invokevirtual_quick:
+        invokeCached(frame, *ins->cache);
+        NEXT();
+
+    op_ireturn: {
+        assert(!frame.stack.empty());
+        auto ir = frame.stack.pop();
+        assert(ir.isStoredAsInteger());
+        return ir;
+    }
+    op_lreturn: {
+        assert(!frame.stack.empty());
+        auto lr = frame.stack.pop();
+        assert(lr.type == Long);
+        return lr;
+    }
+    op_freturn: {
+        assert(!frame.stack.empty());
+        auto fr = frame.stack.pop();
+        assert(fr.type == Float);
+        return fr;
+    }
+    op_dreturn: {
+        assert(!frame.stack.empty());
+        auto dr = frame.stack.pop();
+        assert(dr.type == Double);
+        return dr;
+    }
+    op_areturn: {
+        assert(!frame.stack.empty());
+        auto objectReturn = frame.stack.pop();
+        assert(objectReturn.type == ObjectRef || objectReturn.type == ArrayRef);
+        return objectReturn;
+    }
+    op_return:
+        return Variable();
+}
+
+#endif
@@ -3,23 +3,28 @@
 #include "VmMemory.h"
 #include "StringUtils.h"
 
-static std::string printStringContent(Variable v) {
+static bool stringContent(Variable v, std::u16string& content) {
     assert(v.type == ObjectRef);
     assert(v.value.object->type->name() == "java/lang/String");
-    auto data = v.value.object->fields["java/lang/String__value"];
-    if (data.value.object == nullptr){
-        return "<uninitialized>";
+    static const Symbol* valueKey = Symbol::intern("java/lang/String__value");
+    Variable * field = v.value.object->publicField(valueKey);
+    if (field == nullptr || field->value.object == nullptr){
+        return false;
     }
+    Variable data = *field;
     assert(data.isArray());
 
+    const uint16_t* chars = data.array()->data<uint16_t>();
+    content.assign(chars, chars + data.array()->length);
+    return true;
+}
 
-    std::u16string dataCopy;
-    dataCopy.resize(data.array()->length);
-    for (size_t i = 0; i < data.array()->length; i++){
-        dataCopy[i] = (uint16_t) data.array()->values[i].iv;
+static std::string printStringContent(Variable v) {
+    std::u16string content;
+    if (!stringContent(v, content)){
+        return "<uninitialized>";
     }
-    std::string utf8String = stringutils::utf16toUtf8(dataCopy);
-    return utf8String;
+    return stringutils::utf16toUtf8(content);
 }
 
 std::string Variable::toString() const {
@@ -76,7 +81,7 @@ bool Variable::isArray() const {
 
 Array* Variable::array() {
     assert(isArray());
-    return (value.object->array.get());
+    return value.object->array;
 }
 
 std::string Variable::stringValue() const {
@@ -84,4 +89,15 @@ std::string Variable::stringValue() const {
         throw std::invalid_argument("Not a string");
     }
     return printStringContent(*this);
+}
+
+std::u16string Variable::utf16StringValue() const {
+    if (type != ObjectRef || value.object == nullptr || !value.object->type || value.object->type->name() != "java/lang/String"){
+        throw std::invalid_argument("Not a string");
+    }
+    std::u16string content;
+    if (!stringContent(*this, content)){
+        throw std::invalid_argument("Uninitialized string");
+    }
+    return content;
 }
\ No newline at end of file
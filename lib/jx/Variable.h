@@ -162,6 +162,9 @@ struct Variable {
 
     std::string stringValue() const;
 
+    /** Content of a java/lang/String without conversion. */
+    std::u16string utf16StringValue() const;
+
     VariableType type;
     ValueUnion value;
 };
\ No newline at end of file
@@ -1,56 +1,193 @@
 #include "VmMemory.h"
 #include "DescriptorParser.h"
 #include "Log.h"
+#include <chrono>
+#include <limits>
+#include <memory>
+
+const size_t VmMemory::DefaultMaxHeapSize;
+const size_t VmMemory::InitialCollectionThreshold;
+const size_t VmMemory::RegionSize;
+
+// Fields and array elements follow their headers directly
+static_assert(sizeof(Object) % alignof(Variable) == 0, "Object header must keep fields aligned");
+static_assert(sizeof(Array) % alignof(ValueUnion) == 0, "Array header must keep elements aligned");
+
+namespace {
+
+/** Maximum number of empty regions kept for reuse. */
+const size_t MaxFreeRegions = 4;
+
+size_t alignBlock(size_t size) {
+    const size_t alignment = alignof(Object);
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+/** Smallest block, a hole needs an object header to be skipped by forEachObject. */
+const size_t MinBlockSize = alignBlock(sizeof(Object));
+
+template <typename Function>
+void forEachObject(AllocationRegion& region, Function fn) {
+    char* position = region.begin;
+    while (position < region.top){
+        Object* object = reinterpret_cast<Object*>(position);
+        position += object->blockSize;
+        fn(object);
+    }
+}
+
+}
+
+void Array::copy(const Array& src, int32_t srcPos, Array& target, int32_t targetPos, int32_t length) {
+    if (src.type != target.type && !(src.memoryType() == ObjectRef && target.memoryType() == ObjectRef)){
+        throw std::invalid_argument(std::string("Array copy from ") + variableTypeToString(src.type) + " to " + variableTypeToString(target.type));
+    }
+    // Bounds are checked once in 64 bit, so that position + length can't overflow
+    if (srcPos < 0 || targetPos < 0 || length < 0
+        || (int64_t) srcPos + length > src.length || (int64_t) targetPos + length > target.length){
+        throw std::invalid_argument("Array copy out of bounds, srcPos=" + util::toString(srcPos) + " targetPos=" + util::toString(targetPos) + " length=" + util::toString(length));
+    }
+    // Elements are stored packed, so this is also right for references (no store checks, we have no ArrayStoreException)
+    size_t width = src.elementWidth;
+    std::memmove(target.elements + targetPos * width, src.elements + srcPos * width, length * width);
+}
 
 VmMemory::VmMemory() {
 
 }
 
 VmMemory::~VmMemory() {
-    for (auto object : mObjects){
-        delete object;
+    for (auto& region : mRegions){
+        forEachObject(*region, &VmMemory::destroy);
+    }
+}
+
+char* VmMemory::allocateBlock(size_t& size) {
+    AllocationRegion* region = mCurrentRegion;
+    if (size > RegionSize / 4 || !region || (size_t) (region->end - region->top) < size){
+        // Holes are used before the heap grows
+        char* hole = allocateHole(size);
+        if (hole){
+            return hole;
+        }
+        if (size > RegionSize / 4){
+            // Big objects get a region on their own, freed as soon as the object dies
+            region = addRegion(size);
+        } else {
+            if (!mFreeRegions.empty()){
+                mRegions.push_back(std::move(mFreeRegions.back()));
+                mFreeRegions.pop_back();
+                region = mRegions.back().get();
+            } else {
+                region = addRegion(RegionSize);
+            }
+            mCurrentRegion = region;
+        }
+    }
+    char* block = region->top;
+    region->top += size;
+    region->liveObjects++;
+    mUsedBytes += size;
+    return block;
+}
+
+char* VmMemory::allocateHole(size_t& size) {
+    auto i = mHoles.lower_bound(size);
+    if (i == mHoles.end()){
+        return nullptr;
+    }
+    size_t holeSize = i->first;
+    Hole hole = i->second;
+    mHoles.erase(i);
+    if (holeSize - size >= MinBlockSize){
+        addHole(hole.block + size, holeSize - size, hole.region);
+    } else {
+        // The rest can't hold a header, it belongs to the object
+        size = holeSize;
+    }
+    hole.region->liveObjects++;
+    mUsedBytes += size;
+    return hole.block;
+}
+
+void VmMemory::addHole(char* block, size_t size, AllocationRegion* region) {
+    Object* hole = new (block) Object();
+    hole->blockSize = size;
+    hole->dead = true;
+    mHoles.emplace(size, Hole { block, region });
+}
+
+AllocationRegion* VmMemory::addRegion(size_t capacity) {
+    if (mHeapSize + capacity > mMaxHeapSize){
+        // Empty regions kept for reuse give way first
+        releaseFreeRegions();
+    }
+    if (mHeapSize + capacity > mMaxHeapSize){
+        throw std::invalid_argument("Out of memory, heap regions need " + util::toString(mHeapSize + capacity) + " bytes for a new region of "
+                                    + util::toString(capacity) + " bytes, max heap size " + util::toString(mMaxHeapSize));
+    }
+    AllocationRegion* region = new AllocationRegion(capacity);
+    mRegions.emplace_back(region);
+    mHeapSize += capacity;
+    return region;
+}
+
+void VmMemory::releaseFreeRegions() {
+    for (const auto& region : mFreeRegions){
+        mHeapSize -= region->capacity();
+    }
+    mFreeRegions.clear();
+}
+
+void VmMemory::destroy(Object* object) {
+    if (!object->dead){
+        object->~Object();
     }
 }
 
 Variable VmMemory::allocateObject(const std::shared_ptr<ClassFile> &type) {
-    Object * object = new Object();
+    const std::vector<Variable>& prototype = type->instancePrototype();
+    size_t size = alignBlock(sizeof(Object) + prototype.size() * sizeof(Variable));
+    char* block = allocateBlock(size);
+
+    Object * object = new (block) Object();
     object->type = type;
+    object->blockSize = size;
+    Variable* fields = reinterpret_cast<Variable*>(block + sizeof(Object));
+    std::uninitialized_copy(prototype.begin(), prototype.end(), fields);
+    object->fields = InlineArray<Variable>(fields, prototype.size());
 
-    mObjects.push_back(object);
-
-    ClassFilePtr currentClass = type;
-    while(currentClass){
-        auto fields = currentClass->fields();
-        for (const auto& field : fields){
-            if (!field.isStatic){
-                std::string name = field.isPrivate ? currentClass->name() + "__" + field.name : field.name;
-                DescriptorParser descriptorParser (field.descriptor);
-                object->fields[name].type = descriptorParser.type();
-                logd("Initialized field ", name, " of new instance of ", type->name());
-            }
-        }
-        currentClass = currentClass->superClassFile().lock();
+    return object;
+}
+
+Object* VmMemory::createArray(const VariableType &arrayType, size_t len) {
+    if (len > std::numeric_limits<uint32_t>::max()){
+        throw std::invalid_argument("Array size " + util::toString(len) + " too big");
     }
+    size_t size = alignBlock(sizeof(Object) + sizeof(Array) + len * Array::elementSize(arrayType));
+    // Object::blockSize has 32 bits, the heap walk of the collector depends on it
+    if (size > std::numeric_limits<uint32_t>::max()){
+        throw std::invalid_argument("Array of " + util::toString(len) + " elements needs " + util::toString(size) + " bytes, too big");
+    }
+    char* block = allocateBlock(size);
 
+    Object * object = new (block) Object();
+    object->blockSize = size;
+    char* elements = block + sizeof(Object) + sizeof(Array);
+    object->array = new (block + sizeof(Object)) Array(len, arrayType, elements);
     return object;
 }
 
 Variable VmMemory::allocateArray(const VariableType &arrayType, size_t len) {
-    Object * object = new Object();
-    mObjects.push_back(object);
-    object->array = std::shared_ptr<Array>(new Array(len, arrayType));
-
     Variable arrayReference (ArrayRef);
-    arrayReference.value.object = object;
+    arrayReference.value.object = createArray(arrayType, len);
     return arrayReference;
 }
 
 Variable VmMemory::allocateObjectArray(size_t len, const std::string &descriptor) {
-    logd("Allocate array of type ", descriptor);
-    Object * object = new Object();
-    object->array = std::shared_ptr<Array>(new Array(len, ObjectRef));
-    object->array->objectType = descriptor;
-    mObjects.push_back(object);
+    logt("Allocate array of type ", descriptor);
+    Object * object = createArray(ObjectRef, len);
+    object->array->objectType = &*mArrayTypes.insert(descriptor).first;
     Variable arrayReference (ArrayRef);
     arrayReference.value.object = object;
     return arrayReference;
@@ -64,17 +201,147 @@ Variable VmMemory::getGlobal(const GlobalVariableIdentifier &identifier) {
     return globalIt->second;
 }
 
+Variable* VmMemory::globalSlot(const GlobalVariableIdentifier &identifier) {
+    auto globalIt = mGlobals.find(identifier);
+    if (globalIt == mGlobals.end()){
+        throw std::invalid_argument("Global static " + identifier.toString() + " not found");
+    }
+    // unordered_map never moves its elements
+    return &globalIt->second;
+}
+
 void VmMemory::putGlobal(const GlobalVariableIdentifier &identifier, const Variable& value) {
     auto globalIt = mGlobals.find(identifier);
     if (globalIt == mGlobals.end()){
         throw std::invalid_argument("Could not find global referenced by" + identifier.toString());
     }
-    if (globalIt->second.memoryType() != value.memoryType()){
-        throw std::invalid_argument(std::string("Type of variable mismatch, expected ") + variableTypeToString(globalIt->second.type) + " found " + variableTypeToString(value.type));
+    storeGlobal(&globalIt->second, value);
+}
+
+void VmMemory::storeGlobal(Variable* slot, const Variable& value) {
+    if (slot->memoryType() != value.memoryType()){
+        throw std::invalid_argument(std::string("Type of variable mismatch, expected ") + variableTypeToString(slot->type) + " found " + variableTypeToString(value.type));
     }
-    globalIt->second.value = value.value;
+    slot->value = value.value;
 }
 
 void VmMemory::initGlobal(const GlobalVariableIdentifier &identifier, const VariableType &type) {
     mGlobals[identifier] = Variable(type);
-}
\ No newline at end of file
+}
+
+void VmMemory::mark(const Variable& variable) {
+    if (variable.memoryType() == ObjectRef){
+        mark(variable.value.object);
+    }
+}
+
+void VmMemory::mark(Object* object) {
+    if (object == nullptr || object->marked){
+        return;
+    }
+    object->marked = true;
+    mMarkStack.push_back(object);
+}
+
+void VmMemory::collect(const std::function<void (VmMemory&)>& markRoots) {
+    auto start = std::chrono::steady_clock::now();
+
+    for (const auto& global : mGlobals){
+        mark(global.second);
+    }
+    markRoots(*this);
+
+    while (!mMarkStack.empty()){
+        Object* object = mMarkStack.back();
+        mMarkStack.pop_back();
+        for (const Variable& field : object->fields){
+            mark(field);
+        }
+        if (object->array && object->array->memoryType() == ObjectRef){
+            Object** elements = object->array->data<Object*>();
+            for (uint32_t i = 0; i < object->array->length; i++){
+                mark(elements[i]);
+            }
+        }
+    }
+
+    size_t freedBytes = 0;
+    size_t liveBytes = 0;
+    size_t liveObjects = 0;
+    std::vector<std::unique_ptr<AllocationRegion>> regions;
+    regions.swap(mRegions);
+    mHoles.clear();
+    for (auto& region : regions){
+        region->liveObjects = 0;
+        // Adjacent dead objects are merged into the first one
+        std::vector<Object*> holes;
+        Object* previousHole = nullptr;
+        forEachObject(*region, [&](Object* object) {
+            uint32_t size = object->blockSize;
+            if (!object->dead){
+                if (object->marked){
+                    object->marked = false;
+                    region->liveObjects++;
+                    liveBytes += size;
+                    previousHole = nullptr;
+                    return;
+                }
+                // Non moving, the block becomes a hole
+                object->~Object();
+                object = new (object) Object();
+                object->blockSize = size;
+                object->dead = true;
+                freedBytes += size;
+            }
+            if (previousHole){
+                previousHole->blockSize += size;
+            } else {
+                previousHole = object;
+                holes.push_back(object);
+            }
+        });
+        liveObjects += region->liveObjects;
+        if (region->liveObjects > 0){
+            for (Object* hole : holes){
+                char* block = reinterpret_cast<char*>(hole);
+                if (region.get() == mCurrentRegion && block + hole->blockSize == region->top){
+                    // Bump allocated again
+                    region->top = block;
+                } else {
+                    mHoles.emplace(hole->blockSize, Hole { block, region.get() });
+                }
+            }
+            mRegions.push_back(std::move(region));
+        } else if (region.get() == mCurrentRegion){
+            region->top = region->begin;
+            mRegions.push_back(std::move(region));
+        } else if (region->capacity() == RegionSize && mFreeRegions.size() < MaxFreeRegions){
+            region->top = region->begin;
+            mFreeRegions.push_back(std::move(region));
+        } else {
+            mHeapSize -= region->capacity();
+        }
+    }
+    if (mHeapSize > mMaxHeapSize){
+        releaseFreeRegions();
+    }
+    mUsedBytes = liveBytes;
+    // Amortize the collection time over the allocations
+    mCollectionThreshold = std::min(std::max(InitialCollectionThreshold, 2 * liveBytes), mMaxHeapSize);
+
+    auto pause = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    mGcStatistics.collections++;
+    mGcStatistics.lastPauseMicros = pause;
+    mGcStatistics.totalPauseMicros += pause;
+    mGcStatistics.lastBytesFreed = freedBytes;
+    mGcStatistics.totalBytesFreed += freedBytes;
+    mGcStatistics.liveObjects = liveObjects;
+    mGcStatistics.liveBytes = liveBytes;
+    mGcStatistics.heapBytes = mHeapSize;
+    logd("Garbage collection freed", freedBytes, "bytes, live objects", liveObjects, "pause (us)", pause);
+
+    if (mHeapSize > mMaxHeapSize){
+        throw std::invalid_argument("Out of memory, heap regions need " + util::toString(mHeapSize) + " bytes for " + util::toString(liveBytes)
+                                    + " bytes of live objects, max heap size " + util::toString(mMaxHeapSize));
+    }
+}
@@ -2,23 +2,100 @@
 #include "Variable.h"
 #include "ClassFile.h"
 #include "types.h"
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <unordered_set>
+#include <boost/noncopyable.hpp>
 
+/** Elements stored inline behind an object header, see VmMemory. */
+template <typename T>
+struct InlineArray {
+    InlineArray() : data(nullptr), count(0) {}
+    InlineArray(T* data, size_t count) : data(data), count(count) {}
+
+    T& operator[](size_t index) const { return data[index]; }
+    size_t size() const { return count; }
+    T* begin() const { return data; }
+    T* end() const { return data + count; }
+
+    T* data;
+    size_t count;
+};
+
+/** Java array, the elements are stored in their native width (e.g. one byte for byte[]) behind this header. */
 struct Array {
-    Array(uint32_t length, VariableType type){
+    Array(uint32_t length, VariableType type, void* elements) {
         this->length = length;
         this->type = type;
-        ValueUnion proto = defaultValue(type);
-        this->values.resize(this->length, proto);
+        this->elementWidth = elementSize(type);
+        this->elements = static_cast<char*>(elements);
+        // Default values (0, 0.0, null) are all zero bits
+        std::memset(elements, 0, (size_t) length * elementWidth);
     }
 
     uint32_t length;
     VariableType type;
+    uint32_t elementWidth;
 
     VariableType memoryType() const {
         return returnMemoryType(type);
     }
 
-    std::string objectType; // Type of the objects (if objectRef)
+    // Type of the objects (if objectRef), owned by VmMemory
+    const std::string* objectType = nullptr;
+
+    /** Element access, T must be of the width of the elements (e.g. uint16_t for char[]). */
+    template <typename T>
+    T& at(uint32_t index) const {
+        assert(sizeof(T) == elementWidth);
+        assert(index < length);
+        return reinterpret_cast<T*>(elements)[index];
+    }
+
+    template <typename T>
+    T* data() const {
+        assert(sizeof(T) == elementWidth);
+        return reinterpret_cast<T*>(elements);
+    }
+
+    /** Implementation of System.arraycopy, copies as if through a temporary array, so src and target may overlap.
+        Throws if the element types differ or a range is out of bounds. */
+    static void copy(const Array& src, int32_t srcPos, Array& target, int32_t targetPos, int32_t length);
+
+    /** Bytes needed per element. */
+    static uint32_t elementSize(VariableType type) {
+        switch (type){
+            case Boolean:
+            case Byte:
+                return 1;
+            case Char:
+            case Short:
+                return 2;
+            case Integer:
+            case Float:
+                return 4;
+            case Long:
+            case Double:
+                return 8;
+            case ObjectRef:
+            case ArrayRef:
+                return sizeof(Object*);
+            default:
+                throw std::invalid_argument(std::string("Invalid array type ") + variableTypeToString(type));
+        }
+    }
+
+    // Conversion between elements and the (widened) values of the operand stack
+    static void toValue(ValueUnion& value, int32_t element) { value.iv = element; }
+    static void toValue(ValueUnion& value, int64_t element) { value.lv = element; }
+    static void toValue(ValueUnion& value, float element) { value.fv = element; }
+    static void toValue(ValueUnion& value, double element) { value.dv = element; }
+    static void toValue(ValueUnion& value, Object* element) { value.object = element; }
+
+    template <typename T>
+    static T fromValue(const ValueUnion& value) { return (T) value.iv; }
 
     static VariableType fromArrayTypeCode(uint8_t typeCode){
         switch (typeCode){
@@ -35,52 +112,109 @@ struct Array {
         }
     }
 
-    std::vector<ValueUnion> values;
+    char* elements;
 };
 
+template <> inline int64_t Array::fromValue<int64_t>(const ValueUnion& value) { return value.lv; }
+template <> inline float Array::fromValue<float>(const ValueUnion& value) { return value.fv; }
+template <> inline double Array::fromValue<double>(const ValueUnion& value) { return value.dv; }
+template <> inline Object* Array::fromValue<Object*>(const ValueUnion& value) { return value.object; }
+
 struct Object {
     // Class Type?
     std::shared_ptr<ClassFile> type;
 
-    // Variables
-    std::unordered_map<std::string, Variable> fields;
+    // Variables, laid out like type->instanceFields()
+    InlineArray<Variable> fields;
 
     Variable * publicField (const std::string & name ) {
-        auto it = fields.find(name);
-        return it == fields.end() ? nullptr : &it->second;
+        int slot = type ? type->instanceFieldSlot(name) : -1;
+        return slot < 0 ? nullptr : &fields[slot];
+    }
+    Variable * publicField (const Symbol* name) {
+        int slot = type ? type->instanceFieldSlot(name) : -1;
+        return slot < 0 ? nullptr : &fields[slot];
     }
 
     Variable * privateField (const std::string& className, const std::string & name) {
-        std::string fullName = className + "__" + name;
-        auto it = fields.find(fullName);
-        return it == fields.end() ? nullptr : &it->second;
+        return publicField(className + "__" + name);
     }
 
-    std::shared_ptr<Array> array;
+    Array* array = nullptr;
 
+    /** Size of the allocation, including fields or array elements. Bigger blocks are rejected, so regions and their merged holes fit as well. */
+    uint32_t blockSize = 0;
+    /** Reached in the current garbage collection. */
+    bool marked = false;
+    /** Freed, the block is a hole until it is allocated again or its region is recycled. */
+    bool dead = false;
 };
 
 
 struct GlobalVariableIdentifier {
-    std::string className;
-    std::string name;
+    const Symbol* className;
+    const Symbol* name;
 
-    std::string toString() const { return className + "::" + name; }
+    std::string toString() const { return className->str() + "::" + name->str(); }
 
-    std::size_t hash() const { return hash::combineHash(hash::stringHash(className), hash::stringHash(name)); }
+    std::size_t hash() const { return hash::combineHash(className->hash(), name->hash()); }
 };
 
 inline bool operator< (const GlobalVariableIdentifier& a, const GlobalVariableIdentifier& b){
-    return a.className == b.className ? a.name < b.name : a.className < b.className;
+    return a.className == b.className ? a.name->str() < b.name->str() : a.className->str() < b.className->str();
 }
 
 inline bool operator==(const GlobalVariableIdentifier& a, const GlobalVariableIdentifier& b){
     return a.className == b.className && a.name == b.name;
 }
 
-/** Handles Heap Memory. */
+/** Counters of the garbage collector. */
+struct GcStatistics {
+    uint64_t collections = 0;
+    /** Duration of the last collection. */
+    uint64_t lastPauseMicros = 0;
+    uint64_t totalPauseMicros = 0;
+    uint64_t lastBytesFreed = 0;
+    uint64_t totalBytesFreed = 0;
+    /** State after the last collection. */
+    size_t liveObjects = 0;
+    size_t liveBytes = 0;
+    /** Bytes of all allocation regions, see VmMemory::heapSize. */
+    size_t heapBytes = 0;
+};
+
+/** Memory objects are bump allocated from, owned by the allocating (the only) Java thread. */
+struct AllocationRegion : public boost::noncopyable {
+    AllocationRegion(size_t capacity) : memory(new char[capacity]) {
+        begin = memory.get();
+        top = begin;
+        end = begin + capacity;
+    }
+
+    size_t capacity() const { return end - begin; }
+
+    std::unique_ptr<char[]> memory;
+    char* begin;
+    char* top;
+    char* end;
+    /** Objects not freed yet, the region is recycled if it drops to zero. */
+    size_t liveObjects = 0;
+};
+
+/** Handles Heap Memory.
+
+    Objects are placed into AllocationRegions, with their fields or array elements directly behind the header.
+    They are collected by a mark & sweep collector, which doesn't move objects: adjacent dead objects are merged
+    into holes, which are handed out again before the heap grows. It doesn't know the roots on its own,
+    the owner (Interpreter) marks them in collect() and decides when it is safe to collect. */
 class VmMemory {
 public:
+    static const size_t DefaultMaxHeapSize = 256 * 1024 * 1024;
+    /** Heap size triggering the first collection. */
+    static const size_t InitialCollectionThreshold = 4 * 1024 * 1024;
+    /** Capacity of an allocation region, bigger objects get a region on their own. */
+    static const size_t RegionSize = 1024 * 1024;
+
     VmMemory();
     ~VmMemory();
 
@@ -89,20 +223,83 @@ public:
     Variable allocateObjectArray(size_t len, const std::string& descriptor);
 
     void putGlobal(const std::string& className, const std::string& variableName, const Variable& value) {
-        putGlobal(GlobalVariableIdentifier { className, variableName }, value);
+        putGlobal(GlobalVariableIdentifier { Symbol::intern(className), Symbol::intern(variableName) }, value);
     }
     void putGlobal(const GlobalVariableIdentifier& identifier, const Variable& value);
     Variable getGlobal(const std::string& className, const std::string& variableName) {
-        return getGlobal(GlobalVariableIdentifier { className, variableName });
+        return getGlobal(GlobalVariableIdentifier { Symbol::intern(className), Symbol::intern(variableName) });
     }
     void initGlobal(const std::string& className, const std::string& variableName, const VariableType& type){
-        initGlobal(GlobalVariableIdentifier { className, variableName }, type);
+        initGlobal(GlobalVariableIdentifier { Symbol::intern(className), Symbol::intern(variableName) }, type);
     }
     void initGlobal(const GlobalVariableIdentifier& identifier, const VariableType& type);
 
 
     Variable getGlobal(const GlobalVariableIdentifier& identifier);
+
+    /** Returns the storage of a global, stays valid for the lifetime of VmMemory. */
+    Variable* globalSlot(const GlobalVariableIdentifier& identifier);
+
+    /** Assigns a global, checking the type. */
+    static void storeGlobal(Variable* slot, const Variable& value);
+
+    /** Bytes of all allocation regions, including the holes in them and the empty regions kept for reuse. */
+    size_t heapSize() const { return mHeapSize; }
+
+    /** Approximated size of all objects allocated and not freed yet. */
+    size_t usedBytes() const { return mUsedBytes; }
+
+    /** Collections fail with an exception, if the regions still exceed this size after freeing the dead objects. */
+    void setMaxHeapSize(size_t bytes) {
+        mMaxHeapSize = bytes;
+        mCollectionThreshold = std::min(mCollectionThreshold, bytes);
+    }
+    size_t maxHeapSize() const { return mMaxHeapSize; }
+
+    /** True if enough was allocated to justify a collection, or the regions exceed the max heap size. */
+    bool needsCollection() const { return mUsedBytes >= mCollectionThreshold || mHeapSize > mMaxHeapSize; }
+
+    /** Marks the globals and the roots given by markRoots, frees all objects not reachable from them. */
+    void collect(const std::function<void (VmMemory&)>& markRoots);
+
+    /** Marks a root, only valid inside of collect(). */
+    void mark(const Variable& variable);
+    void mark(Object* object);
+
+    const GcStatistics& gcStatistics() const { return mGcStatistics; }
 private:
-    std::vector<Object*> mObjects;
+    /** Returns uninitialized memory for an object of size bytes, size is rounded up if a slightly bigger hole is used. */
+    char* allocateBlock(size_t& size);
+    /** Takes the smallest hole of at least size bytes, returns null if there is none. */
+    char* allocateHole(size_t& size);
+    /** Marks a block as hole and adds it to mHoles. */
+    void addHole(char* block, size_t size, AllocationRegion* region);
+    /** Adds a region to mRegions, throws if the heap would grow beyond the max heap size. */
+    AllocationRegion* addRegion(size_t capacity);
+    /** Returns the empty regions kept for reuse. */
+    void releaseFreeRegions();
+    Object* createArray(const VariableType& arrayType, size_t len);
+    static void destroy(Object* object);
+
+    std::vector<std::unique_ptr<AllocationRegion>> mRegions;
+    /** Region allocated from, within mRegions. */
+    AllocationRegion* mCurrentRegion = nullptr;
+    /** Empty regions, ready for reuse. */
+    std::vector<std::unique_ptr<AllocationRegion>> mFreeRegions;
+    struct Hole {
+        char* block;
+        AllocationRegion* region;
+    };
+    /** Free blocks within mRegions by size, found by the last collection. */
+    std::multimap<size_t, Hole> mHoles;
+    /** Element types of object arrays. */
+    std::unordered_set<std::string> mArrayTypes;
+    /** Objects marked, but whose references are not marked yet. */
+    std::vector<Object*> mMarkStack;
+    size_t mHeapSize = 0;
+    size_t mUsedBytes = 0;
+    size_t mMaxHeapSize = DefaultMaxHeapSize;
+    size_t mCollectionThreshold = InitialCollectionThreshold;
+    GcStatistics mGcStatistics;
     std::unordered_map<GlobalVariableIdentifier, Variable, hash::MethodHash<GlobalVariableIdentifier>> mGlobals;
 };
\ No newline at end of file
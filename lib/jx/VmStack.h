@@ -0,0 +1,60 @@
+#pragma once
+#include "Variable.h"
+#include <boost/noncopyable.hpp>
+
+/** Contiguous memory for the local variables and operand stacks of the Java thread.
+
+    Every method invocation carves its frame (locals followed by the operand stack)
+    out of this region. The frame of a callee starts at the arguments on the operand stack
+    of the caller, so that arguments are passed without copying. */
+class VmStack : public boost::noncopyable {
+public:
+    static const size_t DefaultCapacity = 256 * 1024;
+
+    VmStack(size_t capacity = DefaultCapacity) : mMemory(new Variable[capacity]) {
+        mBegin = mMemory.get();
+        mEnd = mBegin + capacity;
+        mTop = mBegin;
+    }
+
+    /** First unused slot. */
+    Variable* top() const { return mTop; }
+
+    /** Marks [begin, begin + count) as used, begin must be within the used region or the top.
+        Returns the old top which must be given to release() afterwards. */
+    Variable* reserve(Variable* begin, size_t count) {
+        assert(begin >= mBegin && begin <= mTop);
+        if (count > (size_t) (mEnd - begin)){
+            throw std::invalid_argument("VM stack overflow");
+        }
+        Variable* oldTop = mTop;
+        if (begin + count > mTop){
+            mTop = begin + count;
+        }
+        return oldTop;
+    }
+
+    void release(Variable* oldTop) {
+        mTop = oldTop;
+    }
+
+    /** Releases a reserved region at the end of the scope, e.g. when an exception unwinds the interpreter. */
+    class Reservation : public boost::noncopyable {
+    public:
+        Reservation(VmStack& stack, Variable* begin, size_t count) : mStack(stack) {
+            mOldTop = stack.reserve(begin, count);
+        }
+        ~Reservation() {
+            mStack.release(mOldTop);
+        }
+    private:
+        VmStack& mStack;
+        Variable* mOldTop;
+    };
+
+private:
+    std::unique_ptr<Variable[]> mMemory;
+    Variable* mBegin;
+    Variable* mEnd;
+    Variable* mTop;
+};
@@ -0,0 +1,65 @@
+#include <gtest/gtest.h>
+#include <jx/ClassArchive.h>
+#include <boost/filesystem.hpp>
+#include <fstream>
+
+namespace {
+
+ByteArrayPtr bytes(const std::string& content) {
+    return std::make_shared<ByteArray>(content.begin(), content.end());
+}
+
+struct ClassArchiveTest : public testing::Test {
+    ClassArchiveTest() {
+        path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("jx-%%%%%%%%.jsa")).string();
+    }
+    ~ClassArchiveTest() {
+        boost::filesystem::remove(path);
+    }
+    std::string path;
+};
+
+}
+
+TEST_F(ClassArchiveTest, writeAndFind) {
+    std::map<std::string, ByteArrayPtr> classes;
+    classes["java/lang/Object"] = bytes("object");
+    classes["java/lang/String"] = bytes("string class");
+    classes["a/B"] = bytes("");
+    JarStamp jar;
+    jar.path = "odd.jar";
+    jar.size = 123;
+    jar.modificationTime = 456;
+    ClassArchive::write(path, { jar }, classes);
+
+    ClassArchive archive (path);
+    ASSERT_EQ(3u, archive.classCount());
+    ASSERT_EQ(1u, archive.sources().size());
+    ASSERT_TRUE(archive.sources()[0] == jar);
+
+    for (const auto& c : classes){
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        ASSERT_TRUE(archive.find(c.first, data, size)) << c.first;
+        ASSERT_EQ(*c.second, ByteArray(data, data + size)) << c.first;
+    }
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    ASSERT_FALSE(archive.find("java/lang/Obj", data, size));
+    ASSERT_FALSE(archive.find("java/lang/Objects", data, size));
+    ASSERT_FALSE(archive.find("", data, size));
+}
+
+TEST_F(ClassArchiveTest, invalidArchive) {
+    {
+        std::ofstream out (path.c_str());
+        out << "not an archive";
+    }
+    ASSERT_THROW(ClassArchive archive (path), std::invalid_argument);
+
+    std::map<std::string, ByteArrayPtr> classes;
+    classes["java/lang/Object"] = bytes("object");
+    ClassArchive::write(path, {}, classes);
+    boost::filesystem::resize_file(path, boost::filesystem::file_size(path) - 1);
+    ASSERT_THROW(ClassArchive archive (path), std::invalid_argument);
+}
@@ -1,6 +1,10 @@
 #include <gtest/gtest.h>
 
 #include <jx/Interpreter.h>
+#include <jx/Profiler.h>
+#include <jx/Ops.h>
+#include <sstream>
+#include <boost/filesystem.hpp>
 
 struct InterpreterTest : public testing::Test {
     InterpreterTest(){
@@ -82,3 +86,237 @@ TEST_F (InterpreterTest, simpleShiftTest){
     Variable retValue = interpreter.callStatic("jx/test/InterpreterTest", "simpleShiftTest", variables);
     ASSERT_EQ(None, retValue.type);
 }
+
+TEST_F (InterpreterTest, fieldLayoutTest){
+    Variables variables;
+    Variable retValue = interpreter.callStatic("jx/test/InterpreterTest", "fieldLayoutTest", variables);
+    ASSERT_EQ(Integer, retValue.type);
+    ASSERT_EQ(133, retValue.value.iv);
+}
+
+TEST_F (InterpreterTest, interfaceStaticFieldTest){
+    Variables variables;
+    Variable retValue = interpreter.callStatic("jx/test/InterpreterTest", "interfaceStaticFieldTest", variables);
+    ASSERT_EQ(Integer, retValue.type);
+    ASSERT_EQ(8, retValue.value.iv);
+}
+
+TEST_F (InterpreterTest, virtualDispatchTest){
+    Variables variables;
+    Variable retValue = interpreter.callStatic("jx/test/InterpreterTest", "virtualDispatchTest", variables);
+    ASSERT_EQ(Integer, retValue.type);
+    // Rect: 6 + 60 + 4, Square: 25 + 35 + 6, Rect: 70, then rect.area() = 25 and plain.scaledArea(2) = 12
+    ASSERT_EQ(243, retValue.value.iv);
+}
+
+TEST_F (InterpreterTest, defaultOverrideTest){
+    Variables variables;
+    Variable retValue = interpreter.callStatic("jx/test/InterpreterTest", "defaultOverrideTest", variables);
+    ASSERT_EQ(Integer, retValue.type);
+    // The most specific default method wins, regardless of the interface type of the call
+    ASSERT_EQ(222, retValue.value.iv);
+}
+
+TEST_F (InterpreterTest, stringInternTest){
+    Variables variables;
+    Variable retValue = interpreter.callStatic("jx/test/InterpreterTest", "stringInternTest", variables);
+    ASSERT_EQ(Integer, retValue.type);
+    ASSERT_EQ(111, retValue.value.iv);
+}
+
+TEST_F (InterpreterTest, primitiveArrayTest){
+    Variables variables;
+    Variable retValue = interpreter.callStatic("jx/test/InterpreterTest", "primitiveArrayTest", variables);
+    ASSERT_EQ(Integer, retValue.type);
+    ASSERT_EQ(739944, retValue.value.iv);
+}
+
+TEST_F (InterpreterTest, stringIntrinsicsTest){
+    Variables variables;
+    Variable retValue = interpreter.callStatic("jx/test/InterpreterTest", "stringIntrinsicsTest", variables);
+    ASSERT_EQ(Integer, retValue.type);
+    ASSERT_EQ(127, retValue.value.iv);
+}
+
+TEST_F (InterpreterTest, tableSwitchTest){
+    Variables variables;
+    Variable retValue = interpreter.callStatic("jx/test/InterpreterTest", "tableSwitchTest", variables);
+    ASSERT_EQ(Integer, retValue.type);
+    ASSERT_EQ(104, retValue.value.iv);
+}
+
+TEST_F (InterpreterTest, classArchive){
+    std::string archiveFile = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("jx-%%%%%%%%.jsa")).string();
+    Variables variables;
+    interpreter.classLoader().recordClasses();
+    Variable reference = interpreter.callStatic("jx/test/InterpreterTest", "virtualDispatchTest", variables);
+    interpreter.classLoader().writeArchive(archiveFile);
+
+    Interpreter shared;
+    shared.classLoader().addDefaultPaths();
+    shared.classLoader().addPath(util::executableDirectory() + "/../lib/test.jar");
+    auto archive = std::make_shared<ClassArchive>(archiveFile);
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    ASSERT_TRUE(archive->find("java/lang/Object", data, size));
+    ASSERT_TRUE(shared.classLoader().useArchive(archive));
+    ASSERT_EQ(reference.value.iv, shared.callStatic("jx/test/InterpreterTest", "virtualDispatchTest", variables).value.iv);
+
+    // Archives are bound to the class path they were written for
+    Interpreter other;
+    other.classLoader().addDefaultPaths();
+    ASSERT_FALSE(other.classLoader().useArchive(archive));
+    boost::filesystem::remove(archiveFile);
+}
+
+TEST_F (InterpreterTest, classPrefetching){
+    Variables variables;
+    Variable reference = interpreter.callStatic("jx/test/InterpreterTest", "virtualDispatchTest", variables);
+
+    Interpreter prefetching;
+    prefetching.classLoader().addDefaultPaths();
+    prefetching.classLoader().addPath(util::executableDirectory() + "/../lib/test.jar");
+    prefetching.classLoader().enablePrefetching(2);
+    ASSERT_EQ(reference.value.iv, prefetching.callStatic("jx/test/InterpreterTest", "virtualDispatchTest", variables).value.iv);
+    ASSERT_TRUE(prefetching.classLoader().prefetcher() != nullptr);
+    ASSERT_GT(prefetching.classLoader().prefetcher()->queued(), 0u);
+    ASSERT_LE(prefetching.classLoader().prefetcher()->parsed(), ClassPrefetcher::DefaultMaxParsed);
+
+    // Restarted with the new class path
+    prefetching.classLoader().addPath(util::executableDirectory() + "/../lib/main.jar");
+    ASSERT_TRUE(prefetching.classLoader().prefetcher() == nullptr);
+}
+
+TEST_F (InterpreterTest, classFileBorrowsSource){
+    ClassFilePtr classFile = interpreter.classLoader().loadByName("jx/test/InterpreterTest");
+    const ByteView& source = classFile->source();
+    auto method = classFile->methodWithName("tableSwitchTest");
+    ASSERT_TRUE((bool) method);
+    // Code is not copied out of the class file
+    CodeIdentifier code = classFile->codeForMethod(*method);
+    ASSERT_TRUE(code.code.begin >= source.begin() && code.code.end <= source.end());
+    ASSERT_EQ("tableSwitchTest", classFile->methodName(*method));
+}
+
+TEST_F (InterpreterTest, classFileIndices){
+    ClassFilePtr string = interpreter.classLoader().loadByName("java/lang/String");
+    const MethodInfo* length = string->lookupMethod(Symbol::intern("length"), Symbol::intern("()I"));
+    ASSERT_TRUE(length != nullptr);
+    ASSERT_EQ("length", string->methodName(*length));
+    ASSERT_TRUE(string->lookupMethod(Symbol::intern("length"), Symbol::intern("()J")) == nullptr);
+    auto indexOf = string->methodWithName("indexOf");
+    ASSERT_TRUE((bool) indexOf);
+    ASSERT_EQ("indexOf", string->methodName(*indexOf));
+    ASSERT_FALSE((bool) string->methodWithName("noSuchMethodAnywhere"));
+
+    const FieldInfo* value = string->lookupField("value");
+    ASSERT_TRUE(value != nullptr);
+    ASSERT_EQ("[C", string->getUtf8Constant(value->descriptorIdx));
+    ASSERT_TRUE(string->lookupField("noSuchFieldAnywhere") == nullptr);
+    // Cached, not rebuilt
+    ASSERT_EQ(&string->fields(), &string->fields());
+}
+
+TEST_F (InterpreterTest, profiler){
+    Variables variables;
+    Variable reference = interpreter.callStatic("jx/test/InterpreterTest", "virtualDispatchTest", variables);
+
+    Profiler profiler;
+    interpreter.setProfiler(&profiler);
+    uint64_t instructionsBefore = interpreter.instructionCount();
+    Variable profiled = interpreter.callStatic("jx/test/InterpreterTest", "virtualDispatchTest", variables);
+    interpreter.setProfiler(nullptr);
+    ASSERT_EQ(reference.value.iv, profiled.value.iv);
+    ASSERT_EQ(interpreter.instructionCount() - instructionsBefore, profiler.instructions());
+    ASSERT_GT(profiler.opcodeCount(ops::invokeinterface), 0u);
+
+    bool found = false;
+    for (const MethodProfile& method : profiler.methods()){
+        if (method.methodName != "virtualDispatchTest"){
+            continue;
+        }
+        found = true;
+        ASSERT_EQ(1u, method.invocations);
+        ASSERT_EQ(profiler.instructions(), method.inclusiveInstructions);
+        ASSERT_LT(method.exclusiveInstructions, method.inclusiveInstructions);
+        // The Shape.area() site sees both classes
+        size_t polymorphicSites = 0;
+        for (const auto& site : method.receivers){
+            if (site.second.count("jx/test/InterpreterTest$Rect") && site.second.count("jx/test/InterpreterTest$Square")){
+                polymorphicSites++;
+            }
+        }
+        ASSERT_GT(polymorphicSites, 0u);
+    }
+    ASSERT_TRUE(found);
+}
+
+TEST_F (InterpreterTest, stackSampler){
+    StackSampler sampler;
+    interpreter.setStackSampler(&sampler);
+    // Taken when entering the method
+    sampler.requestSample();
+    Variables variables;
+    interpreter.callStatic("jx/test/InterpreterTest", "virtualDispatchTest", variables);
+    interpreter.setStackSampler(nullptr);
+    ASSERT_EQ(1u, sampler.sampleCount());
+    std::ostringstream folded;
+    sampler.writeFolded(folded);
+    ASSERT_EQ("jx.test.InterpreterTest::virtualDispatchTest 1\n", folded.str());
+}
+
+#ifdef JX_THREADED_DISPATCH
+/** Interpreter of its own per engine, so that the second engine does not run on resolutions and
+    initializations the first one already did. */
+struct EngineRun {
+    EngineRun(DispatchMode mode){
+        interpreter.classLoader().addDefaultPaths();
+        interpreter.classLoader().addPath(util::executableDirectory() + "/../lib/test.jar");
+        interpreter.setDispatchMode(mode);
+    }
+
+    Variable call(const char* method){
+        Variables variables;
+        return interpreter.callStatic("jx/test/InterpreterTest", method, variables);
+    }
+
+    Interpreter interpreter;
+};
+
+TEST (DispatchTest, dispatchEnginesAgree){
+    const char* methods[] = { "leftShiftTest", "shortHashCodeTest", "helloHashCode", "fieldLayoutTest", "virtualDispatchTest", "stringInternTest", "primitiveArrayTest", "stringIntrinsicsTest", "tableSwitchTest" };
+    for (const char* method : methods){
+        EngineRun switchRun (SwitchDispatch);
+        EngineRun threadedRun (ThreadedDispatch);
+        Variable reference = switchRun.call(method);
+        Variable threaded = threadedRun.call(method);
+        ASSERT_EQ(reference.type, threaded.type) << method;
+        ASSERT_EQ(reference.value.iv, threaded.value.iv) << method;
+    }
+
+    const char* stringMethods[] = { "concatenatedStringTest", "handConcatenatedStringTest" };
+    for (const char* method : stringMethods){
+        EngineRun switchRun (SwitchDispatch);
+        EngineRun threadedRun (ThreadedDispatch);
+        ASSERT_EQ(switchRun.call(method).stringValue(), threadedRun.call(method).stringValue()) << method;
+    }
+}
+
+TEST_F (InterpreterTest, inlineCacheStats){
+    Variables variables;
+    interpreter.setDispatchMode(ThreadedDispatch);
+    interpreter.callStatic("jx/test/InterpreterTest", "virtualDispatchTest", variables);
+    size_t sites = 0;
+    for (const CallSiteStats& stats : interpreter.callSiteStats()){
+        if (stats.methodName != "virtualDispatchTest"){
+            continue;
+        }
+        sites++;
+        // Loop over Rect, Square, Rect or the final Square
+        ASSERT_NE(Megamorphic, stats.state) << stats.callee;
+        ASSERT_EQ(stats.receiverCount, stats.misses) << stats.callee;
+        ASSERT_LE(stats.receiverCount, 2u) << stats.callee;
+    }
+    ASSERT_EQ(4u, sites);
+}
+#endif
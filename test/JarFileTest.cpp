@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+#include <jx/JarFile.h>
+#include <jx/Util.h>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <zlib.h>
+
+namespace {
+
+struct ZipEntry {
+    std::string name;
+    std::string content;
+    bool deflate;
+};
+
+void put16(std::string& out, uint16_t value) {
+    out.push_back(value & 0xff);
+    out.push_back(value >> 8);
+}
+
+void put32(std::string& out, uint32_t value) {
+    put16(out, value & 0xffff);
+    put16(out, value >> 16);
+}
+
+std::string deflated(const std::string& content) {
+    z_stream stream = z_stream();
+    deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    std::string result (deflateBound(&stream, content.size()), 0);
+    stream.next_in = (Bytef*) content.data();
+    stream.avail_in = content.size();
+    stream.next_out = (Bytef*) &result[0];
+    stream.avail_out = result.size();
+    deflate(&stream, Z_FINISH);
+    result.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result;
+}
+
+/** Minimal zip writer, with a trailing comment like some tools add. */
+void writeZip(const std::string& path, const std::vector<ZipEntry>& entries) {
+    std::string data;
+    std::string directory;
+    for (const auto& e : entries){
+        std::string payload = e.deflate ? deflated(e.content) : e.content;
+        uint32_t crc = crc32(0, (const Bytef*) e.content.data(), e.content.size());
+        uint32_t offset = data.size();
+        put32(data, 0x04034b50);
+        put16(data, 20); put16(data, 0); put16(data, e.deflate ? 8 : 0); put32(data, 0);
+        put32(data, crc); put32(data, payload.size()); put32(data, e.content.size());
+        put16(data, e.name.size()); put16(data, 0);
+        data += e.name + payload;
+
+        put32(directory, 0x02014b50);
+        put16(directory, 20); put16(directory, 20); put16(directory, 0); put16(directory, e.deflate ? 8 : 0); put32(directory, 0);
+        put32(directory, crc); put32(directory, payload.size()); put32(directory, e.content.size());
+        put16(directory, e.name.size()); put16(directory, 0); put16(directory, 0);
+        put16(directory, 0); put16(directory, 0); put32(directory, 0); put32(directory, offset);
+        directory += e.name;
+    }
+    std::string end;
+    put32(end, 0x06054b50);
+    put16(end, 0); put16(end, 0); put16(end, entries.size()); put16(end, entries.size());
+    put32(end, directory.size()); put32(end, data.size());
+    std::string comment = "a comment";
+    put16(end, comment.size());
+    std::ofstream out (path.c_str(), std::ios::binary);
+    out << data << directory << end << comment;
+}
+
+std::string str(const ByteView& view) {
+    return std::string(view.begin(), view.end());
+}
+
+struct JarFileTest : public testing::Test {
+    JarFileTest() {
+        path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("jx-%%%%%%%%.jar")).string();
+    }
+    ~JarFileTest() {
+        boost::filesystem::remove(path);
+    }
+    std::string path;
+};
+
+}
+
+TEST_F(JarFileTest, storedAndDeflated) {
+    std::string big;
+    for (int i = 0; i < 1000; i++){
+        big += "repeated content " + std::to_string(i % 10);
+    }
+    writeZip(path, { {"a/Stored.class", "stored bytes", false}, {"a/Deflated.class", big, true}, {"a/", "", false} });
+
+    auto jar = std::make_shared<JarFile>(path);
+    ASSERT_EQ(3u, jar->entryCount());
+    ByteView stored = jar->find("a/Stored.class");
+    ASSERT_TRUE((bool) stored);
+    ASSERT_EQ("stored bytes", str(stored));
+    ASSERT_EQ(big, str(jar->find("a/Deflated.class")));
+    ASSERT_FALSE((bool) jar->find("a/Missing.class"));
+    ASSERT_FALSE((bool) jar->find("a/stored.class"));
+
+    // Stored entries point into the mapping, which lives as long as the view
+    jar.reset();
+    ASSERT_EQ("stored bytes", str(stored));
+}
+
+TEST_F(JarFileTest, brokenJar) {
+    ASSERT_THROW(JarFile("/does/not/exist.jar"), std::invalid_argument);
+    {
+        std::ofstream out (path.c_str());
+        out << "no zip file";
+    }
+    auto jar = std::make_shared<JarFile>(path);
+    ASSERT_THROW(jar->find("a/B.class"), std::invalid_argument);
+}
+
+TEST_F(JarFileTest, antJar) {
+    auto jar = std::make_shared<JarFile>(util::executableDirectory() + "/../lib/main.jar");
+    ASSERT_GT(jar->entryCount(), 0u);
+    ByteView object = jar->find("jx/system/System.class");
+    ASSERT_TRUE((bool) object);
+    // Class file magic
+    ASSERT_EQ(0xca, object.data[0]);
+    ASSERT_EQ(0xfe, object.data[1]);
+}
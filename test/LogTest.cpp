@@ -0,0 +1,49 @@
+#include <gtest/gtest.h>
+#include <jx/Log.h>
+#include <boost/thread/thread.hpp>
+#include <sstream>
+#include <iostream>
+
+TEST(LogTest, asyncPerThreadOrder) {
+    std::ostringstream output;
+    std::streambuf* previous;
+    logging::logFlush();
+    {
+        logging::LogLockGuard guard;
+        previous = std::cerr.rdbuf(output.rdbuf());
+    }
+    const int threadCount = 4;
+    const int messageCount = 3000; // More than fit into a ring
+    std::vector<std::unique_ptr<boost::thread>> threads;
+    for (int t = 0; t < threadCount; t++){
+        threads.emplace_back(new boost::thread([t, messageCount] {
+            for (int i = 0; i < messageCount; i++){
+                ::logging::log(__FILE__, __LINE__, ::logging::LL_WARNING, "thread", t, "message", i);
+            }
+        }));
+    }
+    for (auto& thread : threads){
+        thread->join();
+    }
+    logging::logFlush();
+    {
+        logging::LogLockGuard guard;
+        std::cerr.rdbuf(previous);
+    }
+
+    std::vector<int> next(threadCount, 0);
+    std::istringstream lines(output.str());
+    std::string line;
+    while (std::getline(lines, line)){
+        size_t pos = line.find("thread ");
+        ASSERT_NE(std::string::npos, pos) << line;
+        int t, i;
+        std::string word;
+        std::istringstream(line.substr(pos + 7)) >> t >> word >> i;
+        ASSERT_EQ(next[t], i) << "messages of a thread must stay in order";
+        next[t]++;
+    }
+    for (int t = 0; t < threadCount; t++){
+        ASSERT_EQ(messageCount, next[t]);
+    }
+}
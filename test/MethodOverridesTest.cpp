@@ -0,0 +1,43 @@
+#include <gtest/gtest.h>
+#include <jx/MethodOverrides.h>
+
+static Variable answer(const FunctionContext&, const LocalArray&) {
+    return Variable((int32_t) 42);
+}
+
+static MethodOverrideIdentifier identifier(const std::string& methodName) {
+    MethodOverrideIdentifier id;
+    id.className = Symbol::intern("jx/Test");
+    id.methodName = Symbol::intern(methodName);
+    id.description = Symbol::intern("()I");
+    return id;
+}
+
+TEST(MethodOverridesTest, plainFunctionsAndClosures) {
+    MethodOverrides overrides;
+    overrides.add("jx/Test", "function", "()I", answer);
+    overrides.add("jx/Test", "lambda", "()I", [](const FunctionContext&, const LocalArray&) {
+        return Variable((int32_t) 1);
+    });
+    int32_t state = 7;
+    overrides.add("jx/Test", "closure", "()I", [state](const FunctionContext&, const LocalArray&) {
+        return Variable(state);
+    });
+
+    FunctionContext context {};
+    LocalArray variables;
+    const MethodOverride* function = overrides.find(identifier("function"));
+    ASSERT_TRUE(function != nullptr);
+    ASSERT_TRUE(function->function == &answer);
+    ASSERT_EQ(42, function->call(context, variables).value.iv);
+
+    const MethodOverride* lambda = overrides.find(identifier("lambda"));
+    ASSERT_TRUE(lambda->function != nullptr);
+    ASSERT_EQ(1, lambda->call(context, variables).value.iv);
+
+    const MethodOverride* closure = overrides.find(identifier("closure"));
+    ASSERT_TRUE(closure->function == nullptr);
+    ASSERT_EQ(7, closure->call(context, variables).value.iv);
+
+    ASSERT_TRUE(overrides.find(identifier("missing")) == nullptr);
+}
@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+#include <jx/Interpreter.h>
+#include <jx/Profiler.h>
+#include <sstream>
+
+namespace {
+
+PreparedMethod preparedMethod(const std::string& name) {
+    PreparedMethod prepared ("()V");
+    prepared.methodName = Symbol::intern(name);
+    prepared.descriptorSymbol = Symbol::intern("()V");
+    return prepared;
+}
+
+const MethodProfile& find(const std::vector<MethodProfile>& methods, const std::string& name) {
+    for (const MethodProfile& method : methods){
+        if (method.methodName == name){
+            return method;
+        }
+    }
+    throw std::invalid_argument("No profile for " + name);
+}
+
+}
+
+TEST(ProfilerTest, inclusiveAndExclusiveInstructions) {
+    PreparedMethod outer = preparedMethod("outer");
+    PreparedMethod inner = preparedMethod("inner");
+    Profiler profiler;
+
+    profiler.enterMethod(outer);
+    profiler.instruction(0x1a);
+    profiler.enterMethod(inner);
+    profiler.instruction(0x1a);
+    profiler.instruction(0x60);
+    // Recursion, counted once inclusive
+    profiler.enterMethod(inner);
+    profiler.instruction(0x60);
+    profiler.leaveMethod();
+    profiler.leaveMethod();
+    profiler.instruction(0xac);
+    profiler.leaveMethod();
+
+    std::vector<MethodProfile> methods = profiler.methods();
+    ASSERT_EQ(2u, methods.size());
+    const MethodProfile& o = find(methods, "outer");
+    const MethodProfile& i = find(methods, "inner");
+    ASSERT_EQ(1u, o.invocations);
+    ASSERT_EQ(5u, o.inclusiveInstructions);
+    ASSERT_EQ(2u, o.exclusiveInstructions);
+    ASSERT_EQ(2u, i.invocations);
+    ASSERT_EQ(3u, i.inclusiveInstructions);
+    ASSERT_EQ(3u, i.exclusiveInstructions);
+    // Most exclusive instructions first
+    ASSERT_EQ("inner", methods[0].methodName);
+
+    ASSERT_EQ(5u, profiler.instructions());
+    ASSERT_EQ(2u, profiler.opcodeCount(0x60));
+}
+
+TEST(ProfilerTest, reports) {
+    PreparedMethod method = preparedMethod("run\"quoted\"");
+    Profiler profiler;
+    profiler.startSampling(100);
+    profiler.enterMethod(method);
+    profiler.instruction(0x00);
+    profiler.receiver(7, Variable());
+    profiler.leaveMethod();
+    profiler.stopSampling();
+
+    std::ostringstream json;
+    profiler.writeJson(json);
+    ASSERT_NE(std::string::npos, json.str().find("\"instructions\":1"));
+    ASSERT_NE(std::string::npos, json.str().find("\"nop\":1"));
+    ASSERT_NE(std::string::npos, json.str().find("\"method\":\"run\\\"quoted\\\"\""));
+    ASSERT_NE(std::string::npos, json.str().find("{\"pc\":7,\"receivers\":{\"null\":1}}"));
+
+    std::ostringstream report;
+    profiler.writeReport(report);
+    ASSERT_NE(std::string::npos, report.str().find("Methods by exclusive instructions"));
+    ASSERT_NE(std::string::npos, report.str().find("@7: null=1"));
+}
@@ -0,0 +1,40 @@
+#include <gtest/gtest.h>
+#include <jx/Symbol.h>
+#include <boost/thread/thread.hpp>
+
+TEST(SymbolTest, interning) {
+    const Symbol* object = Symbol::intern("java/lang/Object");
+    std::string copy = "java/lang/Object";
+    ASSERT_EQ(object, Symbol::intern(copy));
+    ASSERT_EQ(object, Symbol::intern(copy.data(), copy.size()));
+    ASSERT_EQ(object, Symbol::find(copy));
+    ASSERT_EQ("java/lang/Object", object->str());
+    ASSERT_EQ(std::hash<std::string>()(copy), object->hash());
+
+    ASSERT_NE(object, Symbol::intern("java/lang/Objec"));
+    ASSERT_TRUE(Symbol::find("never/interned/Class") == nullptr);
+    const Symbol* empty = Symbol::intern("");
+    ASSERT_EQ(empty, Symbol::intern(std::string()));
+    ASSERT_TRUE(empty->str().empty());
+}
+
+TEST(SymbolTest, concurrentInterning) {
+    const int Threads = 4;
+    const int Symbols = 1000;
+    std::vector<std::vector<const Symbol*>> results (Threads);
+    std::vector<std::unique_ptr<boost::thread>> threads;
+    for (int t = 0; t < Threads; t++){
+        threads.emplace_back(new boost::thread([t, &results] {
+            for (int i = 0; i < Symbols; i++){
+                results[t].push_back(Symbol::intern("concurrent" + std::to_string(i)));
+            }
+        }));
+    }
+    for (auto& thread : threads){
+        thread->join();
+    }
+    for (int t = 1; t < Threads; t++){
+        ASSERT_EQ(results[0], results[t]);
+    }
+    ASSERT_EQ("concurrent42", results[0][42]->str());
+}
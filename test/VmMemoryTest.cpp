@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+#include <jx/VmMemory.h>
+
+TEST(VmMemoryTest, collectUnreachable) {
+    VmMemory memory;
+    Variable outer = memory.allocateObjectArray(2, "[Ljava/lang/Object;");
+    Variable inner = memory.allocateArray(Char, 16);
+    outer.array()->at<Object*>(1) = inner.value.object;
+    for (int i = 0; i < 10; i++){
+        memory.allocateArray(Integer, 100);
+    }
+
+    memory.collect([&](VmMemory& m) {
+        m.mark(outer);
+    });
+    const GcStatistics& stats = memory.gcStatistics();
+    ASSERT_EQ(1u, stats.collections);
+    ASSERT_EQ(2u, stats.liveObjects);
+    ASSERT_GT(stats.lastBytesFreed, 10 * 100 * sizeof(int32_t));
+    ASSERT_EQ(stats.liveBytes, memory.usedBytes());
+    ASSERT_EQ(stats.heapBytes, memory.heapSize());
+
+    // Reachable objects stay valid
+    ASSERT_EQ(inner.value.object, outer.array()->at<Object*>(1));
+    ASSERT_EQ(16u, inner.array()->length);
+
+    memory.collect([](VmMemory&) {});
+    ASSERT_EQ(0u, memory.gcStatistics().liveObjects);
+    ASSERT_EQ(0u, memory.usedBytes());
+}
+
+TEST(VmMemoryTest, reuseHoles) {
+    VmMemory memory;
+    std::vector<Variable> survivors;
+    size_t heapSize = 0;
+    for (int round = 0; round < 20; round++){
+        // A few survivors per round, between dead objects, keep their region alive
+        for (int i = 0; i < 1000; i++){
+            Variable array = memory.allocateArray(Integer, 100);
+            if (i % 100 == 0){
+                survivors.push_back(array);
+            }
+        }
+        memory.collect([&](VmMemory& m) {
+            for (const Variable& survivor : survivors){
+                m.mark(survivor);
+            }
+        });
+        if (round == 0){
+            heapSize = memory.heapSize();
+        }
+    }
+    // The holes were allocated again, instead of new regions
+    ASSERT_EQ(heapSize, memory.heapSize());
+    ASSERT_EQ(survivors.size(), memory.gcStatistics().liveObjects);
+    for (Variable& survivor : survivors){
+        ASSERT_EQ(100u, survivor.array()->length);
+    }
+}
+
+TEST(VmMemoryTest, maxHeapSize) {
+    VmMemory memory;
+    memory.setMaxHeapSize(2 * VmMemory::RegionSize);
+    Variable array = memory.allocateArray(Long, 1024);
+    // Rejected before the heap grows
+    ASSERT_THROW(memory.allocateArray(Byte, 2 * VmMemory::RegionSize), std::invalid_argument);
+    ASSERT_EQ(VmMemory::RegionSize, memory.heapSize());
+    ASSERT_NO_THROW(memory.collect([&](VmMemory& m) { m.mark(array); }));
+
+    memory.setMaxHeapSize(1024);
+    ASSERT_TRUE(memory.needsCollection());
+    ASSERT_THROW(memory.collect([&](VmMemory& m) { m.mark(array); }), std::invalid_argument);
+}
+
+TEST(VmMemoryTest, hugeArray) {
+    VmMemory memory;
+    // About 4.8 GB of elements, more than the block size of an object can describe
+    ASSERT_THROW(memory.allocateArray(Long, 600000000), std::invalid_argument);
+    ASSERT_THROW(memory.allocateArray(Char, INT32_MAX), std::invalid_argument);
+    ASSERT_EQ(0u, memory.heapSize());
+}
+
+TEST(VmMemoryTest, packedArrays) {
+    VmMemory memory;
+    Variable bytes = memory.allocateArray(Byte, 3);
+    ASSERT_EQ(1u, bytes.array()->elementWidth);
+    bytes.array()->at<int8_t>(2) = -1;
+    ASSERT_EQ(0, bytes.array()->at<int8_t>(0));
+    ASSERT_EQ(-1, bytes.array()->at<int8_t>(2));
+
+    ASSERT_EQ(2u, memory.allocateArray(Char, 1).array()->elementWidth);
+    ASSERT_EQ(4u, memory.allocateArray(Float, 1).array()->elementWidth);
+    ASSERT_EQ(8u, memory.allocateArray(Long, 1).array()->elementWidth);
+
+    // char[] needs 2 bytes per element instead of a widened value
+    size_t before = memory.usedBytes();
+    memory.allocateArray(Char, 1024);
+    ASSERT_LT(memory.usedBytes() - before, 1024 * sizeof(int32_t));
+}
+
+TEST(VmMemoryTest, arrayCopy) {
+    VmMemory memory;
+    Array& chars = *memory.allocateArray(Char, 8).array();
+    for (uint32_t i = 0; i < chars.length; i++){
+        chars.at<uint16_t>(i) = i;
+    }
+    // Overlapping, as if copied through a temporary array
+    Array::copy(chars, 0, chars, 2, 6);
+    const uint16_t shifted[] = { 0, 1, 0, 1, 2, 3, 4, 5 };
+    ASSERT_TRUE(std::equal(shifted, shifted + 8, chars.data<uint16_t>()));
+    Array::copy(chars, 2, chars, 0, 6);
+    const uint16_t back[] = { 0, 1, 2, 3, 4, 5, 4, 5 };
+    ASSERT_TRUE(std::equal(back, back + 8, chars.data<uint16_t>()));
+
+    Array& other = *memory.allocateArray(Char, 4).array();
+    Array::copy(chars, 4, other, 0, 4);
+    ASSERT_EQ(5, other.at<uint16_t>(1));
+
+    ASSERT_THROW(Array::copy(chars, 6, other, 0, 4), std::invalid_argument);
+    ASSERT_THROW(Array::copy(chars, 0, other, -1, 1), std::invalid_argument);
+    ASSERT_THROW(Array::copy(chars, 0, *memory.allocateArray(Short, 4).array(), 0, 1), std::invalid_argument);
+}